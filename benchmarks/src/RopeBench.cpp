@@ -0,0 +1,539 @@
+#include "w5n/Rope.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <concepts>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Every allocation made by the process goes through these, so the benchmarks can report allocations per operation.
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size)
+{
+    ++allocations;
+
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    ++allocations;
+    const auto align = static_cast<size_t>(alignment);
+
+    if (void* memory = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return memory;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace {
+
+enum class Text
+{
+    Ascii,
+    Emoji
+};
+
+std::string makeText(Text text, size_t size)
+{
+    static const std::vector<std::string> ascii_words{"lorem", "ipsum", "dolor", "sit", "amet", "rope", "leaf", "\n"};
+    static const std::vector<std::string> emoji_words{"😀", "👶🏽", "café", "naïve", "🇧🇷", "ok", " ", "\n"};
+    const auto& words = text == Text::Ascii ? ascii_words : emoji_words;
+
+    std::mt19937 random{42};
+    std::string result;
+    result.reserve(size + 16);
+
+    while (result.size() < size) {
+        result += words[random() % words.size()];
+        result += ' ';
+    }
+
+    // cut on a code point boundary
+    size_t end = size;
+
+    while (end > 0 && (static_cast<unsigned char>(result[end]) & 0xC0) == 0x80) {
+        --end;
+    }
+
+    result.resize(end);
+
+    return result;
+}
+
+std::vector<size_t> makePositions()
+{
+    std::mt19937_64 random{7};
+    std::vector<size_t> positions(1024);
+
+    for (auto& position : positions) {
+        position = random();
+    }
+
+    return positions;
+}
+
+const std::vector<size_t> positions = makePositions();
+
+// Positions in the units insert/erase/at/substring take: graphemes, or bytes for a w5n::ByteRope.
+template <typename Rope>
+size_t length(const Rope& rope)
+{
+    if constexpr (std::same_as<Rope, w5n::ByteRope>) {
+        return rope.size();
+    } else {
+        return rope.charCount();
+    }
+}
+
+void documentSizes(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->RangeMultiplier(32)->Range(1 << 10, 1 << 30)->Unit(benchmark::kMicrosecond);
+}
+
+// Reports the allocations made inside the timed loop, minus the ones made while resetting the document.
+class AllocationCounter
+{
+  public:
+    explicit AllocationCounter(benchmark::State& state) : state(state), start(allocations), excluded(0)
+    {
+    }
+
+    template <typename Reset>
+    void exclude(Reset reset)
+    {
+        state.PauseTiming();
+        const size_t before = allocations;
+        reset();
+        excluded += allocations - before;
+        state.ResumeTiming();
+    }
+
+    ~AllocationCounter()
+    {
+        state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations - start - excluded),
+                                                         benchmark::Counter::kAvgIterations);
+    }
+
+  private:
+    benchmark::State& state;
+    size_t start;
+    size_t excluded;
+};
+
+template <typename Rope, Text T>
+void RopeAppend(benchmark::State& state)
+{
+    const auto text = makeText(T, static_cast<size_t>(state.range(0)));
+    Rope rope;
+    rope.append(text);
+    const std::string line = "appended line\n";
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            rope.append(line);
+
+            if (rope.size() > 2 * text.size() + 4096) {
+                counter.exclude([&] {
+                    rope = Rope{};
+                    rope.append(text);
+                });
+            }
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * line.size()));
+}
+
+template <Text T>
+void StringAppend(benchmark::State& state)
+{
+    const auto text = makeText(T, static_cast<size_t>(state.range(0)));
+    std::string string = text;
+    const std::string line = "appended line\n";
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            string.append(line);
+
+            if (string.size() > 2 * text.size() + 4096) {
+                counter.exclude([&] {
+                    string = text;
+                });
+            }
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * line.size()));
+}
+
+template <typename Rope, Text T>
+void RopeInsert(benchmark::State& state)
+{
+    const auto text = makeText(T, static_cast<size_t>(state.range(0)));
+    Rope original;
+    original.append(text);
+    auto rope = original;
+    size_t count = length(rope);
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            rope.insert(positions[i++ % positions.size()] % (count + 1), "inserted");
+            count += 8;
+
+            if (rope.size() > text.size() + text.size() / 10 + 4096) {
+                counter.exclude([&] {
+                    rope = original;
+                    count = length(rope);
+                });
+            }
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <Text T>
+void StringInsert(benchmark::State& state)
+{
+    const auto text = makeText(T, static_cast<size_t>(state.range(0)));
+    std::string string = text;
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            string.insert(positions[i++ % positions.size()] % (string.size() + 1), "inserted");
+
+            if (string.size() > text.size() + text.size() / 10 + 4096) {
+                counter.exclude([&] {
+                    string = text;
+                });
+            }
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Rope, Text T>
+void RopeErase(benchmark::State& state)
+{
+    const auto text = makeText(T, static_cast<size_t>(state.range(0)));
+    Rope original;
+    original.append(text);
+    auto rope = original;
+    size_t count = length(rope);
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            rope.erase(positions[i++ % positions.size()] % count, 8);
+            count -= std::min<size_t>(count, 8);
+
+            if (count < length(original) / 2 + 16) {
+                counter.exclude([&] {
+                    rope = original;
+                    count = length(rope);
+                });
+            }
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <Text T>
+void StringErase(benchmark::State& state)
+{
+    const auto text = makeText(T, static_cast<size_t>(state.range(0)));
+    std::string string = text;
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            string.erase(positions[i++ % positions.size()] % string.size(), 8);
+
+            if (string.size() < text.size() / 2 + 16) {
+                counter.exclude([&] {
+                    string = text;
+                });
+            }
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Rope, Text T>
+void RopeAt(benchmark::State& state)
+{
+    Rope rope;
+    rope.append(makeText(T, static_cast<size_t>(state.range(0))));
+    const size_t count = length(rope);
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(rope.at(positions[i++ % positions.size()] % count));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <Text T>
+void StringAt(benchmark::State& state)
+{
+    const auto string = makeText(T, static_cast<size_t>(state.range(0)));
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(string.at(positions[i++ % positions.size()] % string.size()));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Rope, Text T>
+void RopeSubstring(benchmark::State& state)
+{
+    Rope rope;
+    rope.append(makeText(T, static_cast<size_t>(state.range(0))));
+    const size_t count = length(rope);
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(rope.substring(positions[i++ % positions.size()] % count, 256));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <Text T>
+void StringSubstring(benchmark::State& state)
+{
+    const auto string = makeText(T, static_cast<size_t>(state.range(0)));
+    size_t i = 0;
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(string.substr(positions[i++ % positions.size()] % string.size(), 256));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Rope, Text T>
+void RopeToString(benchmark::State& state)
+{
+    Rope rope;
+    rope.append(makeText(T, static_cast<size_t>(state.range(0))));
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(rope.toString());
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * rope.size()));
+}
+
+template <Text T>
+void StringCopy(benchmark::State& state)
+{
+    const auto string = makeText(T, static_cast<size_t>(state.range(0)));
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(std::string{string});
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * string.size()));
+}
+
+template <typename Rope, Text T>
+void RopeFind(benchmark::State& state)
+{
+    Rope rope;
+    rope.append(makeText(T, static_cast<size_t>(state.range(0))));
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(rope.find("not in the text"));
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * rope.size()));
+}
+
+template <Text T>
+void StringFind(benchmark::State& state)
+{
+    const auto string = makeText(T, static_cast<size_t>(state.range(0)));
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(string.find("not in the text"));
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * string.size()));
+}
+
+// Erasing most of a document leaves the leaves at both ends pointing into a buffer that is mostly unreferenced, and
+// compact copies them out of it. The copy of the rope taken on every iteration shares its nodes, and takes no time.
+template <typename Rope, Text T>
+void RopeCompact(benchmark::State& state)
+{
+    auto original = Rope::fromString(makeText(T, static_cast<size_t>(state.range(0))));
+    const size_t count = length(original);
+    original.erase(count / 16, count - count / 8);
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            auto rope = original;
+            rope.compact();
+            benchmark::DoNotOptimize(rope);
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * original.size()));
+}
+
+template <typename Rope, Text T>
+void RopeBuild(benchmark::State& state)
+{
+    const auto text = makeText(T, static_cast<size_t>(state.range(0)));
+
+    {
+        AllocationCounter counter{state};
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(Rope::fromString(text));
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+} // namespace
+
+#define STRING_BENCHMARK(name)                                                                                         \
+    BENCHMARK_TEMPLATE(name, Text::Ascii)->Apply(documentSizes);                                                       \
+    BENCHMARK_TEMPLATE(name, Text::Emoji)->Apply(documentSizes)
+
+#define ROPE_BENCHMARK_OF(name, Rope)                                                                                  \
+    BENCHMARK_TEMPLATE(name, Rope, Text::Ascii)->Apply(documentSizes);                                                 \
+    BENCHMARK_TEMPLATE(name, Rope, Text::Emoji)->Apply(documentSizes)
+
+#ifndef W5N_ROPE_UTF8_IGNORE
+#define ROPE_BENCHMARK(name)                                                                                           \
+    ROPE_BENCHMARK_OF(name, w5n::ByteRope);                                                                            \
+    ROPE_BENCHMARK_OF(name, w5n::GraphemeRope)
+#else
+#define ROPE_BENCHMARK(name) ROPE_BENCHMARK_OF(name, w5n::ByteRope)
+#endif
+
+ROPE_BENCHMARK(RopeAppend);
+STRING_BENCHMARK(StringAppend);
+ROPE_BENCHMARK(RopeInsert);
+STRING_BENCHMARK(StringInsert);
+ROPE_BENCHMARK(RopeErase);
+STRING_BENCHMARK(StringErase);
+ROPE_BENCHMARK(RopeAt);
+STRING_BENCHMARK(StringAt);
+ROPE_BENCHMARK(RopeSubstring);
+STRING_BENCHMARK(StringSubstring);
+ROPE_BENCHMARK(RopeToString);
+STRING_BENCHMARK(StringCopy);
+ROPE_BENCHMARK(RopeFind);
+STRING_BENCHMARK(StringFind);
+ROPE_BENCHMARK(RopeCompact);
+ROPE_BENCHMARK(RopeBuild);
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    if constexpr (std::same_as<w5n::Rope, w5n::ByteRope>) {
+        benchmark::AddCustomContext("w5n_rope_units", "bytes (W5N_ROPE_UTF8_IGNORE)");
+    } else {
+        benchmark::AddCustomContext("w5n_rope_units", "bytes, graphemes");
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
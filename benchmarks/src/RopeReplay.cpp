@@ -0,0 +1,587 @@
+#include "w5n/Rope.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <concepts>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Replays recorded edit traces through Rope::insert and Rope::erase, and reports the latency of every edit.
+//
+// A trace has one edit per line: the position, the number of positions deleted there and the text then inserted
+// there, separated by a single space. Positions are grapheme indexes (byte offsets when built with
+// W5N_ROPE_UTF8_IGNORE), and "\n", "\t", "\r" and "\\" are escaped in the text. Empty lines and lines starting with
+// '#' are ignored:
+//
+//     # typing "hi", then deleting the 'i'
+//     0 0 h
+//     1 0 i
+//     1 1
+
+namespace {
+
+struct Operation
+{
+    size_t position;
+    size_t deleted;
+    std::string text;
+    size_t line;
+};
+
+// Keeps track of the memory a rope holds, to report its peak.
+class CountingResource : public std::pmr::memory_resource
+{
+  public:
+    size_t peak() const
+    {
+        return peakBytes;
+    }
+
+    size_t allocations() const
+    {
+        return allocationCount;
+    }
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        void* memory = upstream->allocate(bytes, alignment);
+        currentBytes += bytes;
+        peakBytes = std::max(peakBytes, currentBytes);
+        ++allocationCount;
+
+        return memory;
+    }
+
+    void do_deallocate(void* memory, size_t bytes, size_t alignment) override
+    {
+        upstream->deallocate(memory, bytes, alignment);
+        currentBytes -= bytes;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource();
+
+    size_t currentBytes = 0;
+
+    size_t peakBytes = 0;
+
+    size_t allocationCount = 0;
+};
+
+std::string escape(std::string_view text)
+{
+    std::string result;
+    result.reserve(text.size());
+
+    for (char c : text) {
+        switch (c) {
+            case '\n':
+                result += "\\n";
+                break;
+            case '\t':
+                result += "\\t";
+                break;
+            case '\r':
+                result += "\\r";
+                break;
+            case '\\':
+                result += "\\\\";
+                break;
+            default:
+                result += c;
+        }
+    }
+
+    return result;
+}
+
+std::optional<std::string> unescape(std::string_view text)
+{
+    std::string result;
+    result.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\\') {
+            result += text[i];
+            continue;
+        }
+
+        if (++i == text.size()) {
+            return std::nullopt;
+        }
+
+        switch (text[i]) {
+            case 'n':
+                result += '\n';
+                break;
+            case 't':
+                result += '\t';
+                break;
+            case 'r':
+                result += '\r';
+                break;
+            case '\\':
+                result += '\\';
+                break;
+            default:
+                return std::nullopt;
+        }
+    }
+
+    return result;
+}
+
+std::optional<Operation> parseOperation(std::string_view line, size_t number)
+{
+    Operation operation{0, 0, {}, number};
+    const char* end = line.data() + line.size();
+
+    auto [after_position, position_error] = std::from_chars(line.data(), end, operation.position);
+
+    if (position_error != std::errc{} || after_position == end || *after_position != ' ') {
+        return std::nullopt;
+    }
+
+    auto [after_deleted, deleted_error] = std::from_chars(after_position + 1, end, operation.deleted);
+
+    if (deleted_error != std::errc{} || (after_deleted != end && *after_deleted != ' ')) {
+        return std::nullopt;
+    }
+
+    if (after_deleted != end) {
+        auto text = unescape(std::string_view{after_deleted + 1, end});
+
+        if (!text) {
+            return std::nullopt;
+        }
+
+        operation.text = std::move(*text);
+    }
+
+    return operation;
+}
+
+std::optional<std::vector<Operation>> readTrace(const std::filesystem::path& path)
+{
+    std::ifstream file{path, std::ios::binary};
+
+    if (!file) {
+        std::cerr << path.string() << ": cannot be read\n";
+        return std::nullopt;
+    }
+
+    std::vector<Operation> operations;
+    std::string line;
+
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        auto operation = parseOperation(line, number);
+
+        if (!operation) {
+            std::cerr << path.string() << ':' << number << ": expected \"<position> <deleted> <text>\"\n";
+            return std::nullopt;
+        }
+
+        operations.push_back(std::move(*operation));
+    }
+
+    return operations;
+}
+
+std::string formatDuration(std::chrono::nanoseconds duration)
+{
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+
+    if (duration < std::chrono::microseconds{1}) {
+        stream << duration.count() << " ns";
+    } else if (duration < std::chrono::milliseconds{1}) {
+        stream << static_cast<double>(duration.count()) / 1e3 << " us";
+    } else {
+        stream << static_cast<double>(duration.count()) / 1e6 << " ms";
+    }
+
+    return stream.str();
+}
+
+std::string formatBytes(size_t bytes)
+{
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+
+    if (bytes < 1024) {
+        stream << bytes << " B";
+    } else if (bytes < 1024 * 1024) {
+        stream << static_cast<double>(bytes) / 1024 << " KiB";
+    } else {
+        stream << static_cast<double>(bytes) / (1024 * 1024) << " MiB";
+    }
+
+    return stream.str();
+}
+
+// Positions in the units insert and erase take: graphemes, or bytes when w5n::Rope is a w5n::ByteRope.
+template <typename Rope>
+size_t length(const Rope& rope)
+{
+    if constexpr (std::same_as<Rope, w5n::ByteRope>) {
+        return rope.size();
+    } else {
+        return rope.charCount();
+    }
+}
+
+template <typename Rope>
+std::string formatSize(const Rope& rope)
+{
+    auto size = std::to_string(rope.size()) + " bytes";
+
+    if constexpr (!std::same_as<Rope, w5n::ByteRope>) {
+        size += ", " + std::to_string(rope.charCount()) + " chars";
+    }
+
+    return size;
+}
+
+bool replay(const std::filesystem::path& trace, const std::optional<std::filesystem::path>& initial)
+{
+    auto operations = readTrace(trace);
+
+    if (!operations) {
+        return false;
+    }
+
+    CountingResource resource;
+    w5n::Rope rope{&resource};
+
+    if (initial) {
+        auto document = w5n::Rope::fromFile(*initial, &resource);
+
+        if (!document) {
+            std::cerr << initial->string() << ": cannot be read\n";
+            return false;
+        }
+
+        rope = std::move(*document);
+    }
+
+    std::vector<std::chrono::nanoseconds> latencies;
+    latencies.reserve(operations->size());
+
+    for (const auto& operation : *operations) {
+        // erase clamps what it removes to the end of the rope, so a trace going past it would replay other edits
+        if (operation.position + operation.deleted > length(rope)) {
+            std::cerr << trace.string() << ':' << operation.line << ": deleting " << operation.deleted
+                      << " from position " << operation.position << " goes past the end (" << length(rope) << ")\n";
+            return false;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        bool applied = true;
+
+        if (operation.deleted > 0) {
+            applied = rope.erase(operation.position, operation.deleted);
+        }
+
+        if (applied && !operation.text.empty()) {
+            applied = rope.insert(operation.position, operation.text);
+        }
+
+        latencies.push_back(std::chrono::steady_clock::now() - start);
+
+        if (!applied) {
+            std::cerr << trace.string() << ':' << operation.line << ": position " << operation.position
+                      << " is out of range\n";
+            return false;
+        }
+    }
+
+    std::cout << trace.string() << '\n';
+    std::cout << "  operations:   " << latencies.size() << '\n';
+
+    if (!latencies.empty()) {
+        std::chrono::nanoseconds total{0};
+
+        for (auto latency : latencies) {
+            total += latency;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+
+        std::cout << "  total:        " << formatDuration(total) << '\n';
+        std::cout << "  p50:          " << formatDuration(latencies[latencies.size() / 2]) << '\n';
+        std::cout << "  p99:          " << formatDuration(latencies[latencies.size() * 99 / 100]) << '\n';
+        std::cout << "  max:          " << formatDuration(latencies.back()) << '\n';
+    }
+
+    std::cout << "  final size:   " << formatSize(rope) << '\n';
+    const auto stats = rope.stats();
+    std::cout << "  depth:        " << stats.depth << '\n';
+    std::cout << "  leaves:       " << stats.leaves << " (" << stats.underfullLeaves << " underfull)\n";
+    std::cout << "  peak memory:  " << formatBytes(resource.peak()) << " in " << resource.allocations()
+              << " allocations\n";
+
+    return true;
+}
+
+// Synthetic traces, so results can be compared across versions without recorded sessions. Each inserted piece of
+// text is a single grapheme, which lets the generators keep track of the length of the document.
+class TraceGenerator
+{
+  public:
+    explicit TraceGenerator(unsigned seed) : random(seed), cursor(0), length(0), next(0)
+    {
+    }
+
+    // Someone writing prose: characters typed at the cursor, a few backspaces, and the cursor moving now and then.
+    std::vector<Operation> typing(size_t count)
+    {
+        std::vector<Operation> operations;
+
+        while (operations.size() < count) {
+            const auto roll = random() % 100;
+
+            if (roll < 8 && cursor > 0) {
+                backspace(operations);
+            } else if (roll < 10) {
+                jump();
+            } else {
+                type(operations, nextProse());
+            }
+        }
+
+        return operations;
+    }
+
+    // Editing an existing text: typing mixed with words and lines deleted, lines pasted and selections replaced.
+    std::vector<Operation> editing(size_t count)
+    {
+        std::vector<Operation> operations;
+
+        while (operations.size() < count) {
+            const auto roll = random() % 100;
+
+            if (roll < 40) {
+                type(operations, nextProse());
+            } else if (roll < 50 && cursor > 0) {
+                backspace(operations);
+            } else if (roll < 60) {
+                paste(operations, 0);
+            } else if (roll < 70 && cursor < length) {
+                remove(operations, 1 + random() % 8);
+            } else if (roll < 75 && cursor < length) {
+                remove(operations, 40 + random() % 160);
+            } else if (roll < 85 && cursor < length) {
+                paste(operations, 1 + random() % 20);
+            } else {
+                jump();
+            }
+        }
+
+        return operations;
+    }
+
+    // Chat messages mixing text with emoji, skin tones, ZWJ sequences and combining marks.
+    std::vector<Operation> emoji(size_t count)
+    {
+        static const std::vector<std::string_view> emojis{
+            "😀", "😂", "👍🏽", "👩‍💻", "❤️", "🎉", "é", "ñ", "日", "🙈",
+        };
+        std::vector<Operation> operations;
+
+        while (operations.size() < count) {
+            const auto roll = random() % 100;
+
+            if (roll < 10 && cursor > 0) {
+                backspace(operations);
+            } else if (roll < 12) {
+                jump();
+            } else if (roll < 35) {
+                type(operations, emojis[random() % emojis.size()]);
+            } else {
+                type(operations, nextProse());
+            }
+        }
+
+        return operations;
+    }
+
+  private:
+    static constexpr std::string_view prose =
+        "It was the best of times, it was the worst of times, it was the age of wisdom, it was the age of "
+        "foolishness, it was the epoch of belief, it was the epoch of incredulity, it was the season of Light, it "
+        "was the season of Darkness, it was the spring of hope, it was the winter of despair.\n"
+        "We had everything before us, we had nothing before us, we were all going direct to Heaven, we were all "
+        "going direct the other way.\n\n";
+
+    std::string_view nextProse()
+    {
+        return prose.substr(next++ % prose.size(), 1);
+    }
+
+    void type(std::vector<Operation>& operations, std::string_view grapheme)
+    {
+        operations.push_back({cursor, 0, std::string{grapheme}, 0});
+        ++cursor;
+        ++length;
+    }
+
+    void backspace(std::vector<Operation>& operations)
+    {
+        --cursor;
+        --length;
+        operations.push_back({cursor, 1, {}, 0});
+    }
+
+    void remove(std::vector<Operation>& operations, size_t size)
+    {
+        size = std::min(size, length - cursor);
+        length -= size;
+        operations.push_back({cursor, size, {}, 0});
+    }
+
+    // Pastes a line of the prose, replacing the replaced graphemes after the cursor.
+    void paste(std::vector<Operation>& operations, size_t replaced)
+    {
+        replaced = std::min(replaced, length - cursor);
+        const auto size = 20 + random() % 100;
+        std::string text;
+
+        for (size_t i = 0; i < size; ++i) {
+            text += nextProse();
+        }
+
+        operations.push_back({cursor, replaced, text, 0});
+        length = length - replaced + size;
+        cursor += size;
+    }
+
+    // Mostly short moves around the cursor, sometimes anywhere in the document.
+    void jump()
+    {
+        if (random() % 4 == 0) {
+            cursor = random() % (length + 1);
+            return;
+        }
+
+        const auto distance = random() % 160;
+        cursor = distance < 80 ? cursor - std::min<size_t>(cursor, distance) : std::min(length, cursor + distance - 80);
+    }
+
+    std::mt19937 random;
+
+    size_t cursor;
+
+    size_t length;
+
+    size_t next;
+};
+
+bool generate(std::string_view kind, size_t count, unsigned seed)
+{
+    TraceGenerator generator{seed};
+    std::vector<Operation> operations;
+
+    if (kind == "typing") {
+        operations = generator.typing(count);
+    } else if (kind == "editing") {
+        operations = generator.editing(count);
+    } else if (kind == "emoji") {
+        operations = generator.emoji(count);
+    } else {
+        std::cerr << "unknown trace kind \"" << kind << "\", expected typing, editing or emoji\n";
+        return false;
+    }
+
+    std::cout << "# " << kind << " trace, " << count << " operations, seed " << seed << '\n';
+    std::cout << "# position deleted text\n";
+
+    for (const auto& operation : operations) {
+        std::cout << operation.position << ' ' << operation.deleted;
+
+        if (!operation.text.empty()) {
+            std::cout << ' ' << escape(operation.text);
+        }
+
+        std::cout << '\n';
+    }
+
+    return true;
+}
+
+int usage()
+{
+    std::cerr << "usage: RopeReplay [--initial <file>] <trace>...\n"
+                 "       RopeReplay --generate <typing|editing|emoji> [<operations> [<seed>]]\n";
+
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::vector<std::string_view> arguments(argv + 1, argv + argc);
+
+    if (arguments.empty()) {
+        return usage();
+    }
+
+    if (arguments.front() == "--generate") {
+        if (arguments.size() < 2 || arguments.size() > 4) {
+            return usage();
+        }
+
+        const size_t count = arguments.size() > 2 ? std::strtoull(arguments[2].data(), nullptr, 10) : 10000;
+        const auto seed = arguments.size() > 3 ? static_cast<unsigned>(std::strtoul(arguments[3].data(), nullptr, 10))
+                                               : 42u;
+
+        return generate(arguments[1], count, seed) ? 0 : 1;
+    }
+
+    std::optional<std::filesystem::path> initial;
+    std::vector<std::filesystem::path> traces;
+
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        if (arguments[i] == "--initial") {
+            if (++i == arguments.size()) {
+                return usage();
+            }
+
+            initial = arguments[i];
+        } else {
+            traces.emplace_back(arguments[i]);
+        }
+    }
+
+    if (traces.empty()) {
+        return usage();
+    }
+
+    for (const auto& trace : traces) {
+        if (!replay(trace, initial)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
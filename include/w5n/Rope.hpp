@@ -1,103 +1,836 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iosfwd>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace w5n {
 
-struct Rope
+class RopeHistory;
+
+// What the positions taken by insert, erase, substring and at count, and what a rope is a range of. Ropes counting
+// graphemes or code points keep, in every node, how many of them it holds and, in every leaf, checkpoints to find
+// them; a rope counting bytes keeps neither and never looks at the encoding of its text.
+namespace metrics {
+
+struct Bytes
+{
+    static constexpr bool counted = false;
+};
+
+struct CodePoints
+{
+    static constexpr bool counted = true;
+};
+
+// Only available when the library is built with uni-algo (without W5N_ROPE_UTF8_IGNORE).
+struct Graphemes
+{
+    static constexpr bool counted = true;
+};
+
+} // namespace metrics
+
+template <typename Unit>
+concept RopeUnit = std::same_as<Unit, metrics::Bytes> || std::same_as<Unit, metrics::CodePoints> ||
+                   std::same_as<Unit, metrics::Graphemes>;
+
+template <RopeUnit Unit>
+struct BasicRope
 {
   public:
-    Rope();
+    class ByteIterator;
+    class CharIterator;
+
+    using GraphemeIterator = CharIterator;
+
+    using iterator = std::conditional_t<Unit::counted, CharIterator, ByteIterator>;
+    using const_iterator = iterator;
+
+    // What at returns: the grapheme or code point at an index, or the byte at an offset.
+    using CharType = std::conditional_t<Unit::counted, std::string, char>;
+
+    BasicRope();
 
-    Rope(const Rope&) = default;
-    Rope& operator=(const Rope&) = default;
+    // Nodes and leaf text are allocated from resource (a std::pmr::unsynchronized_pool_resource, for instance), which
+    // must outlive the rope and every copy of it.
+    explicit BasicRope(std::pmr::memory_resource* resource);
 
-    ~Rope();
+    BasicRope(const BasicRope&) = default;
+    BasicRope& operator=(const BasicRope&) = default;
+
+    ~BasicRope();
+
+    // Version of the rope as it is now, sharing every node with it, so taking one is O(1). Nodes are never modified
+    // while shared, so editing either the rope or the snapshot afterwards does not affect the other.
+    BasicRope snapshot() const;
+
+    // Maps a file into memory and builds leaves pointing into the mapping, std::nullopt if it cannot be read. Line
+    // and grapheme counts are computed the first time they are needed. A rope counting bytes is built without reading
+    // the file; the others read the bytes before each leaf boundary, to place it between two characters, which faults
+    // in every page of the mapping once (nothing is copied). The file must not be truncated while the rope, or any
+    // copy of it, is alive.
+    static std::optional<BasicRope> fromFile(const std::filesystem::path& path,
+                                             std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Build a balanced tree in one go from text that is all available up front: it is copied once into a single
+    // buffer that every leaf is a slice of, with no concatenation or rebalancing on the way.
+    static BasicRope fromString(std::string_view content,
+                                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    static BasicRope fromChunks(std::span<const std::string_view> chunks,
+                                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
     void rebalance();
 
     bool isBalanced() const;
 
+    // Number of levels of the tree, 1 when the whole text is a single leaf. Every leaf is at that depth.
+    size_t depth() const;
+
+    // Shape of the tree and memory held by it, from a walk over every node.
+    struct Stats
+    {
+        size_t depth;
+        size_t nodes;
+        size_t leaves;
+
+        // leafSizes[i] counts the leaves of 2^i to 2^(i + 1) - 1 bytes (empty leaves are counted in leafSizes[0]).
+        std::array<size_t, 13> leafSizes;
+
+        // Leaves smaller than the minimum size the tree aims for (a rope that small is one), which compact joins
+        // with their neighbours.
+        size_t underfullLeaves;
+
+        // Bytes of nodes, grapheme indexes and leaf buffers also reachable from other ropes (copies, snapshots,
+        // iterators), and reachable from this rope only.
+        size_t sharedBytes;
+        size_t exclusiveBytes;
+
+        // Bytes of mapped files the leaves point into, which are not part of the two above.
+        size_t mappedBytes;
+
+        // Bytes of buffers no leaf of any rope points into anymore, but which are kept alive by the slices that are.
+        size_t unreferencedBytes;
+    };
+
+    Stats stats() const;
+
+#ifdef W5N_ROPE_COUNTERS
+    // Process-wide totals of the work done by every rope since the start or the last resetCounters.
+    struct Counters
+    {
+        size_t nodeAllocations;
+        size_t bufferAllocations;
+
+        // Leaves split in two by an edit.
+        size_t splits;
+
+        // Calls to concat joining two non-empty trees, including the recursive ones.
+        size_t concats;
+
+        // Underfull or overfull nodes merged or divided by concat, and trees rebuilt by rebalance.
+        size_t rebalances;
+
+        // Leaves copied out of a buffer that was mostly unreferenced, and runs of underfull leaves joined by compact.
+        size_t compactions;
+
+        // Leaves segmented into the characters of the rope to count them.
+        size_t segmentations;
+    };
+
+    static Counters counters();
+
+    static void resetCounters();
+#endif
+
     void append(std::string_view content);
 
     void prepend(std::string_view content);
 
     void clear();
 
+    // Copies the leaves still pointing into mostly unreferenced buffers, so those buffers can be released, and joins
+    // the leaves smaller than the minimum size with their neighbours.
+    void compact();
+
+    // Positions are indexes of the unit the rope counts: graphemes, code points or bytes.
     bool insert(size_t position, std::string_view content);
 
     bool erase(size_t position, size_t size);
 
+    // Byte offsets passed to the editing functions must fall on a grapheme (or code point) boundary, otherwise
+    // nothing is done.
+    bool insertAtByte(size_t offset, std::string_view content);
+
+    bool eraseBytes(size_t offset, size_t size);
+
+    bool insertAtChar(size_t index, std::string_view content)
+        requires Unit::counted;
+
+    bool eraseChars(size_t index, size_t count)
+        requires Unit::counted;
+
+    // Splicing shares the nodes of the other rope instead of copying its text, so it only builds O(log n) nodes
+    // whatever the size of the other rope. Nodes keep the memory resource they were allocated from, which has to
+    // outlive both ropes.
+    void append(const BasicRope& other);
+
+    void prepend(const BasicRope& other);
+
+    bool insert(size_t position, const BasicRope& other);
+
+    bool insertAtByte(size_t offset, const BasicRope& other);
+
+    // Removes a range and returns it as a rope of its own, sharing its nodes. std::nullopt (and nothing removed) when
+    // a byte offset is not on a grapheme boundary.
+    std::optional<BasicRope> extract(size_t position, size_t size);
+
+    std::optional<BasicRope> extractBytes(size_t offset, size_t size);
+
+    // Moves a range so that it starts where position to was before the move. to must not be inside the range.
+    bool move(size_t from, size_t size, size_t to);
+
+    bool moveBytes(size_t from, size_t size, size_t to);
+
+    // Replaces size bytes at offset with text.
+    struct Edit
+    {
+        size_t offset;
+        size_t size;
+        std::string_view text;
+    };
+
+    // Applies edits sorted by offset and not overlapping, their offsets being taken in the rope as it was before the
+    // call, in a single pass over the tree: only the nodes on the way to an edit are visited and rebuilt, the rest is
+    // shared. Nothing is done if any edit is out of order, out of range or not on a grapheme boundary.
+    bool applyEdits(std::span<const Edit> edits);
+
     std::string toString() const;
 
+    // Hands the text of every leaf to visitor, in order and without copying it.
+    void forEachChunk(const std::function<void(std::string_view)>& visitor) const;
+
+    void writeTo(std::ostream& stream) const;
+
+#ifndef _WIN32
+    // Writes the leaves to a file descriptor with writev, returns false (leaving errno set) if writing fails.
+    bool writeTo(int fd) const;
+#endif
+
+    // Saves the rope in a versioned binary format holding its text, the shape of its tree and the grapheme (or code
+    // point) and line counts computed so far, so that deserialize rebuilds the same tree without segmenting the text
+    // again. Ropes counting another unit read the same data, and only recount what they need.
+    bool serialize(std::ostream& stream) const;
+
+    // std::nullopt if the stream does not hold a rope serialized in a known version, or is cut short.
+    static std::optional<BasicRope> deserialize(std::istream& stream,
+                                                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
     std::string substring(size_t from) const;
 
     std::string substring(size_t from, size_t size) const;
 
-    size_t size() const;
+    std::string substringBytes(size_t offset) const;
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-    size_t charCount() const;
+    std::string substringBytes(size_t offset, size_t size) const;
+
+    std::string substringChars(size_t index) const
+        requires Unit::counted;
+
+    std::string substringChars(size_t index, size_t count) const
+        requires Unit::counted;
+
+    // Copies up to size bytes starting at a byte offset into out, returns how many were copied.
+    size_t copyTo(std::span<char> out, size_t offset, size_t size) const;
+
+    // Bytes [offset, offset + size) without copying them when they are all in the same leaf, std::nullopt otherwise.
+    // The view is valid until the rope is modified.
+    std::optional<std::string_view> view(size_t offset, size_t size) const;
+
+    // Searching works on bytes: offsets given and returned are byte offsets, std::string::npos meaning no match.
+    // Matches do not overlap, and may span any number of leaves.
+    size_t find(std::string_view needle, size_t offset = 0) const;
+
+    // Last match starting at or before offset.
+    size_t rfind(std::string_view needle, size_t offset = std::string::npos) const;
+
+    std::vector<size_t> findAll(std::string_view needle) const;
+
+#ifndef W5N_ROPE_SINGLE_THREADED
+    // Runs task(0) to task(count - 1), possibly at the same time on different threads, and returns once they are all
+    // done. A thread pool, or std::for_each with a std::execution policy over the indexes, can be adapted to it.
+    using Executor = std::function<void(size_t count, const std::function<void(size_t)>& task)>;
+
+    // Runs the tasks on up to threads std::threads, started for each call.
+    static Executor threadExecutor(size_t threads = std::thread::hardware_concurrency());
+
+    // Same results as the versions above, computed by splitting the tree into subtrees of about PARALLEL_GRAIN bytes
+    // and handing one to each task.
+    std::string toString(const Executor& executor) const;
+
+    size_t find(std::string_view needle, const Executor& executor) const;
+
+    std::vector<size_t> findAll(std::string_view needle, const Executor& executor) const;
+
+    // Computes the line and grapheme counts that are not known yet, so later lookups find them ready.
+    void computeMetrics(const Executor& executor) const;
+
+    // Same as the builders above, but the line and grapheme counts of the leaves are computed right away, in parallel.
+    static BasicRope fromString(std::string_view content,
+                                const Executor& executor,
+                                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    static BasicRope fromChunks(std::span<const std::string_view> chunks,
+                                const Executor& executor,
+                                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 #endif
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-    const std::string at(size_t index) const;
+    // Lines end with '\n' (so "\r\n" is a single break), and columns are byte offsets from the start of the line.
+    struct LineColumn
+    {
+        size_t line;
+        size_t column;
+    };
+
+    size_t lineCount() const;
+
+    // Byte offset of the first byte of a line, std::string::npos if there is no such line.
+    size_t lineStart(size_t line) const;
+
+    LineColumn offsetToLineCol(size_t offset) const;
+
+    // Columns past the end of the line stop at its end, std::string::npos if there is no such line.
+    size_t lineColToOffset(size_t line, size_t column) const;
+
+    size_t size() const;
+
+    size_t charCount() const
+        requires Unit::counted;
+
+    // Index of the grapheme (or code point) starting at a byte offset (a match, for instance), std::string::npos when
+    // the offset is not on a boundary.
+    size_t charIndex(size_t offset) const
+        requires Unit::counted;
+
+    CharType at(size_t index) const;
+
+    // A rope is a range of the unit it counts: graphemes and code points as std::string_views, or bytes. Iterators
+    // keep the rope contents they were created from alive, so editing the rope does not invalidate them, but they do
+    // not see the edit either.
+    iterator begin() const;
+
+    iterator end() const;
+
+  private:
+    enum class Metric
+    {
+        Bytes,
+        Chars,
+        Lines
+    };
+
+    enum class MetricsState : uint8_t
+    {
+        Pending,
+        Computing,
+        Ready
+    };
+
+    struct RopeNode;
+
+#ifdef W5N_ROPE_SINGLE_THREADED
+    using Counter = size_t;
+    using MetricsFlag = MetricsState;
 #else
-    char at(size_t index) const;
+    using Counter = std::atomic<size_t>;
+    using MetricsFlag = std::atomic<MetricsState>;
 #endif
 
-  private:
-    struct RopeNode : std::enable_shared_from_this<RopeNode>
+    // Immutable text that leaves point into, either owned or a mapped file. liveBytes is the amount of it still
+    // referenced by leaves, so slices of a buffer that is mostly unreferenced can be copied out and the buffer
+    // released. Like nodes, buffers hold their own reference count and the memory resource they came from.
+    struct LeafBuffer
     {
-        std::shared_ptr<const RopeNode> left;
-        std::shared_ptr<const RopeNode> right;
+        mutable Counter refCount;
+        std::pmr::memory_resource* resource;
+        std::pmr::string storage;
+        std::string_view text;
+        void* mapping;
+        mutable Counter liveBytes;
+
+        LeafBuffer(std::string_view value, std::pmr::memory_resource* resource);
+
+        LeafBuffer(size_t capacity, std::pmr::memory_resource* resource);
+
+        explicit LeafBuffer(std::pmr::string&& value);
+
+        LeafBuffer(void* mapped_file, size_t mapped_size);
+
+        LeafBuffer(const LeafBuffer&) = delete;
+        LeafBuffer& operator=(const LeafBuffer&) = delete;
+
+        ~LeafBuffer();
+    };
+
+    // Intrusive handle to a node: the reference count lives in the node itself, so copying a handle is a single
+    // (atomic, unless W5N_ROPE_SINGLE_THREADED is set) increment with no separate control block.
+    class NodePtr
+    {
+      public:
+        NodePtr();
+
+        NodePtr(std::nullptr_t);
+
+        explicit NodePtr(const RopeNode* node);
+
+        NodePtr(const NodePtr& other);
+
+        NodePtr(NodePtr&& other) noexcept;
+
+        NodePtr& operator=(const NodePtr& other);
+
+        NodePtr& operator=(NodePtr&& other) noexcept;
+
+        ~NodePtr();
+
+        const RopeNode* get() const;
+
+        const RopeNode* operator->() const;
+
+        const RopeNode& operator*() const;
+
+        explicit operator bool() const;
+
+        bool operator==(const NodePtr& other) const = default;
+
+        size_t useCount() const;
+
+      private:
+        const RopeNode* node;
+
+        void retain() const;
+
+        void release();
+    };
+
+    // Same handle for the buffers, which every leaf slicing them holds one of.
+    class BufferPtr
+    {
+      public:
+        BufferPtr();
+
+        BufferPtr(std::nullptr_t);
+
+        explicit BufferPtr(const LeafBuffer* buffer);
+
+        BufferPtr(const BufferPtr& other);
+
+        BufferPtr(BufferPtr&& other) noexcept;
+
+        BufferPtr& operator=(const BufferPtr& other);
+
+        BufferPtr& operator=(BufferPtr&& other) noexcept;
+
+        ~BufferPtr();
+
+        const LeafBuffer* get() const;
+
+        const LeafBuffer* operator->() const;
+
+        const LeafBuffer& operator*() const;
+
+        explicit operator bool() const;
+
+        bool operator==(const BufferPtr& other) const = default;
+
+        size_t useCount() const;
+
+      private:
+        const LeafBuffer* buffer;
+
+        void retain() const;
+
+        void release();
+    };
+
+    struct RopeNode
+    {
+        // Leaves hold between MIN_LEAF_SIZE and MAX_LEAF_SIZE bytes (only the ones at the edges of the rope may be
+        // smaller) and internal nodes hold between MIN_CHILDREN and MAX_CHILDREN children, with every leaf at the
+        // same depth.
+        static constexpr size_t MIN_LEAF_SIZE = 512;
+        static constexpr size_t MAX_LEAF_SIZE = 4096;
+        static constexpr size_t MIN_CHILDREN = 8;
+        static constexpr size_t MAX_CHILDREN = 16;
+
+        // Splitting a leaf copies its text out of a buffer bigger than a leaf when less than a
+        // 1 / BUFFER_COMPACTION_RATIO share of that buffer is still referenced.
+        static constexpr size_t BUFFER_COMPACTION_RATIO = 4;
+
+        // Leaves of ropes counting graphemes or code points remember the byte offset of every CHECKPOINT_STEP-th one,
+        // so reaching one only needs to segment the text between the closest checkpoint and it.
+        static constexpr size_t CHECKPOINT_STEP = 16;
+
+        struct Checkpoint
+        {
+            uint32_t index;
+            uint32_t offset;
+        };
+
+        struct CharCounts
+        {
+            size_t count;
+            std::pmr::vector<Checkpoint> checkpoints;
+
+            explicit CharCounts(std::pmr::memory_resource* resource) : count(0), checkpoints(resource)
+            {
+            }
+        };
+
+        struct NoCharCounts
+        {
+            explicit NoCharCounts(std::pmr::memory_resource*)
+            {
+            }
+        };
+
+        mutable Counter refCount;
+        std::pmr::memory_resource* resource;
+        std::array<NodePtr, MAX_CHILDREN> children;
+        size_t childCount;
+        size_t height;
         size_t size;
-#ifndef W5N_ROPE_UTF8_IGNORE
-        size_t charCount;
-#endif
-        std::shared_ptr<std::string> buffer;
+        BufferPtr buffer;
+        size_t offset;
+
+        // Everything but the size is only known once measure has asked for it. Line breaks and characters are
+        // computed separately, so looking up lines never segments the text.
+        mutable MetricsFlag charsState;
+        [[no_unique_address]] mutable std::conditional_t<Unit::counted, CharCounts, NoCharCounts> chars;
+        mutable MetricsFlag linesState;
+        mutable size_t lineBreaks;
 
         RopeNode();
 
-        RopeNode(std::shared_ptr<const RopeNode> left_node, std::shared_ptr<const RopeNode> right_node);
+        explicit RopeNode(std::pmr::memory_resource* resource);
 
-        RopeNode(std::string_view value);
+        RopeNode(std::span<const NodePtr> child_nodes);
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-        std::string at(size_t index) const;
-#else
-        char at(size_t index) const;
-#endif
+        RopeNode(std::string_view value, std::pmr::memory_resource* resource);
+
+        RopeNode(BufferPtr leaf_buffer, size_t leaf_offset, size_t leaf_size, std::pmr::memory_resource* resource);
+
+        RopeNode(BufferPtr leaf_buffer,
+                 size_t leaf_offset,
+                 size_t leaf_size,
+                 size_t char_count,
+                 std::span<const Checkpoint> checkpoints,
+                 std::pmr::memory_resource* resource)
+            requires(Unit::counted);
+
+        ~RopeNode();
+
+        CharType at(size_t index) const;
+
+        std::pair<NodePtr, NodePtr> split(size_t index, Metric metric, std::pmr::memory_resource* resource) const;
+
+        std::pair<NodePtr, NodePtr> splitLeaf(size_t offset, size_t index, std::pmr::memory_resource* resource) const;
+
+        void copyBytes(size_t offset, size_t size, char* out) const;
+
+        std::optional<std::string_view> view(size_t offset, size_t size) const;
 
-        std::pair<std::shared_ptr<const RopeNode>, std::shared_ptr<const RopeNode>> split(size_t index) const;
+        size_t byteOffset(size_t index) const;
 
-        size_t weight() const;
+        size_t lineBreakOffset(size_t line_break) const;
 
-        size_t depth() const;
+        size_t lineBreaksBefore(size_t offset) const;
 
-        std::vector<std::shared_ptr<const RopeNode>> collectLeaves() const;
+        bool isCharBoundary(size_t offset) const;
+
+        // Byte offsets of the start and end of a character, and index of the character starting at a byte offset
+        // (std::string::npos if none does). Characters are the unit of the rope, bytes included.
+        std::pair<size_t, size_t> charBounds(size_t index) const;
+
+        size_t charsBefore(size_t offset) const;
+
+        size_t measure(Metric metric) const;
+
+        // Whether the line breaks and characters (the line breaks only, in a rope counting bytes) are known, and
+        // whether the characters are.
+        bool hasMetrics() const;
+
+        bool hasCharCounts() const;
+
+        void computeMetrics() const;
+
+        void computeLineBreaks() const;
+
+        void computeChars() const;
+
+        void fillLineBreaks() const;
+
+        void fillChars() const;
+
+        // Runs fill once for the first caller while state is Pending, the others waiting for it to be Ready.
+        template <typename Fill>
+        static void computeOnce(MetricsFlag& state, Fill fill);
+
+        std::vector<NodePtr> collectLeaves() const;
 
         bool isLeaf() const;
 
+        bool isUnderfull() const;
+
+        bool isBufferSparse() const;
+
+        std::string_view text() const;
+
+        std::span<const NodePtr> childNodes() const;
+
         std::string toString() const;
+
+        // Bytes taken by the node and its checkpoints, not counting its text.
+        size_t memoryUsage() const;
+    };
+
+    // Root-to-leaf path to one leaf, which can step to the neighbouring leaves without descending from the root again.
+    class Cursor
+    {
+      public:
+        Cursor();
+
+        explicit Cursor(NodePtr root);
+
+        // Moves to the leaf holding position and returns the position relative to that leaf. The end of the rope is
+        // at the end of the last leaf.
+        size_t seek(size_t position, Metric metric);
+
+        bool nextLeaf();
+
+        bool previousLeaf();
+
+        const RopeNode* leaf() const;
+
+        // Only the byte offset is kept up to date while moving, the other metrics are summed along the path.
+        size_t leafStart(Metric metric) const;
+
+      private:
+        struct Frame
+        {
+            const RopeNode* node;
+            size_t child;
+        };
+
+        NodePtr root;
+        std::vector<Frame> path;
+        const RopeNode* current;
+        size_t start;
+
+        void descend(const RopeNode* node, bool leftmost);
+    };
+
+  public:
+    class ByteIterator
+    {
+      public:
+        using value_type = char;
+        using reference = char;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        ByteIterator();
+
+        char operator*() const;
+
+        ByteIterator& operator++();
+
+        ByteIterator operator++(int);
+
+        ByteIterator& operator--();
+
+        ByteIterator operator--(int);
+
+        bool operator==(const ByteIterator& other) const;
+
+        // Byte offset from the beginning of the rope.
+        size_t offset() const;
+
+      private:
+        friend struct BasicRope;
+
+        Cursor cursor;
+        size_t position;
+
+        ByteIterator(NodePtr root, size_t offset);
+    };
+
+    // Graphemes (or code points) are views into the rope's leaves, valid as long as an iterator or a rope holding that
+    // leaf exists.
+    class CharIterator
+    {
+      public:
+        using value_type = std::string_view;
+        using reference = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        CharIterator();
+
+        std::string_view operator*() const;
+
+        CharIterator& operator++();
+
+        CharIterator operator++(int);
+
+        CharIterator& operator--();
+
+        CharIterator operator--(int);
+
+        bool operator==(const CharIterator& other) const;
+
+        // Index from the beginning of the rope.
+        size_t index() const;
+
+        // Byte offset from the beginning of the rope.
+        size_t offset() const;
+
+      private:
+        friend struct BasicRope;
+
+        Cursor cursor;
+        size_t leafIndex;
+        size_t position;
+        size_t first;
+        size_t last;
+
+        CharIterator(NodePtr root, size_t index);
+
+        void loadBounds();
     };
 
-    Rope(std::shared_ptr<const RopeNode> r);
+    std::ranges::subrange<ByteIterator> bytes() const;
+
+    std::ranges::subrange<CharIterator> graphemes() const
+        requires std::same_as<Unit, metrics::Graphemes>;
+
+  private:
+    friend class RopeHistory;
+
+    BasicRope(NodePtr r, std::pmr::memory_resource* resource);
+
+    NodePtr root;
+
+    std::pmr::memory_resource* resource;
+
+    std::pair<NodePtr, NodePtr> split(size_t index, Metric metric) const;
 
-    std::shared_ptr<const RopeNode> root;
+    size_t measure(Metric metric) const;
 
-    std::pair<std::shared_ptr<const RopeNode>, std::shared_ptr<const RopeNode>> split(size_t index) const;
+    bool insert(size_t position, std::string_view content, Metric metric);
 
-    std::shared_ptr<const RopeNode> concat(std::shared_ptr<const RopeNode> left,
-                                           std::shared_ptr<const RopeNode> right) const;
+    bool erase(size_t position, size_t size, Metric metric);
 
-    bool isBalanced(std::shared_ptr<const RopeNode> node) const;
+    bool insert(size_t position, const BasicRope& other, Metric metric);
 
-    std::shared_ptr<const RopeNode> doMerge(const std::vector<std::shared_ptr<const RopeNode>>& leaves,
-                                            size_t start,
-                                            size_t end) const;
+    std::optional<BasicRope> extract(size_t position, size_t size, Metric metric);
+
+    bool move(size_t from, size_t size, size_t to, Metric metric);
+
+    std::string substring(size_t from, size_t size, Metric metric) const;
+
+    template <typename Visitor>
+    void forEachMatch(std::string_view needle, size_t offset, size_t end, Visitor visitor) const;
+
+#ifndef W5N_ROPE_SINGLE_THREADED
+    static constexpr size_t PARALLEL_GRAIN = 1 << 20;
+
+    // Subtrees of at most grain bytes (or single leaves) covering the rope in order, with the byte offset of each.
+    std::vector<std::pair<const RopeNode*, size_t>> subtrees(size_t grain) const;
+#endif
+
+    // Writes content into the first or last leaf when nothing on the way down to it is shared with another rope,
+    // false when it has to be concatenated instead.
+    bool absorbAtEdge(std::string_view content, bool at_end);
+
+    template <typename... Args>
+    static NodePtr allocateNode(std::pmr::memory_resource* resource, Args&&... args);
+
+    template <typename... Args>
+    static BufferPtr allocateBuffer(std::pmr::memory_resource* resource, Args&&... args);
+
+    static NodePtr concat(NodePtr left, NodePtr right, std::pmr::memory_resource* resource);
+
+    static NodePtr makeNode(std::span<const NodePtr> nodes, std::pmr::memory_resource* resource);
+
+    static BufferPtr makeBuffer(std::string_view content, std::pmr::memory_resource* resource);
+
+    static size_t countLineBreaks(std::string_view content);
+
+    static NodePtr compact(NodePtr node, std::pmr::memory_resource* resource);
+
+    static NodePtr joinUnderfullLeaves(NodePtr node, std::pmr::memory_resource* resource);
+
+    static NodePtr makeTree(std::string_view content, std::pmr::memory_resource* resource);
+
+    static std::vector<NodePtr> sliceLeaves(const BufferPtr& buffer,
+                                            std::span<const size_t> boundaries,
+                                            std::pmr::memory_resource* resource);
+
+    static std::vector<NodePtr> makeLeaves(std::string_view content, std::pmr::memory_resource* resource);
+
+    static BufferPtr joinChunks(std::span<const std::string_view> chunks, std::pmr::memory_resource* resource);
+
+    static std::vector<size_t> leafBoundaries(std::string_view content);
+
+    // Leaf boundaries spread evenly over size bytes, whatever they are.
+    static std::vector<size_t> evenBoundaries(size_t size);
+
+    static NodePtr mergeLeaves(NodePtr left, NodePtr right, std::pmr::memory_resource* resource);
+
+    static NodePtr mergeNodes(std::span<const NodePtr> left,
+                              std::span<const NodePtr> right,
+                              std::pmr::memory_resource* resource);
+
+    bool isBalanced(NodePtr node) const;
+
+    static NodePtr doMerge(std::vector<NodePtr> nodes, std::pmr::memory_resource* resource);
+
+    // Parents of nodes of the same height, as few as MAX_CHILDREN allows.
+    static std::vector<NodePtr> makeParents(std::span<const NodePtr> nodes, std::pmr::memory_resource* resource);
 };
 
+// Member functions are defined in Rope.cpp, which instantiates every rope the library is built with.
+extern template struct BasicRope<metrics::Bytes>;
+extern template struct BasicRope<metrics::CodePoints>;
+
+using ByteRope = BasicRope<metrics::Bytes>;
+using CodePointRope = BasicRope<metrics::CodePoints>;
+
+#ifndef W5N_ROPE_UTF8_IGNORE
+extern template struct BasicRope<metrics::Graphemes>;
+
+using GraphemeRope = BasicRope<metrics::Graphemes>;
+using Rope = GraphemeRope;
+#else
+using Rope = ByteRope;
+#endif
+
 } // namespace w5n
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "w5n/Rope.hpp"
+
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <vector>
+
+namespace w5n {
+
+// Undo/redo history of a rope. Every recorded version is a snapshot sharing its unchanged subtrees with the others,
+// so recording after each edit costs a few nodes instead of a copy of the document.
+class RopeHistory
+{
+  public:
+    // At most capacity versions are kept, the oldest ones are dropped first.
+    explicit RopeHistory(size_t capacity = 1000);
+
+    // Records the rope as the current version. Versions that could still be redone are discarded.
+    void record(const Rope& rope);
+
+    // The version before (or after) the current one, which becomes the current one, std::nullopt if there is none.
+    std::optional<Rope> undo();
+
+    std::optional<Rope> redo();
+
+    bool canUndo() const;
+
+    bool canRedo() const;
+
+    // The current version, std::nullopt if nothing has been recorded.
+    std::optional<Rope> current() const;
+
+    // Number of recorded versions, including the ones that can be redone.
+    size_t size() const;
+
+    size_t capacity() const;
+
+    void clear();
+
+    // Bytes of nodes and leaf text that only the version at the same position (oldest first) holds, that is the
+    // memory that would be released if that version alone were dropped.
+    std::vector<size_t> uniqueBytes() const;
+
+  private:
+    std::deque<Rope> versions;
+
+    size_t position;
+
+    size_t limit;
+};
+
+} // namespace w5n
@@ -1,16 +1,36 @@
 #include "w5n/Rope.hpp"
 
 #include <algorithm>
+#include <bit>
 #include <cwchar>
+#include <exception>
 #include <iostream>
+#include <istream>
 #include <memory>
 #include <numeric>
-#include <sstream>
+#include <ostream>
 #include <stack>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
 #ifndef W5N_ROPE_UTF8_IGNORE
 #include <iterator>
 #include <uni_algo/break_grapheme.h>
@@ -19,448 +39,3564 @@
 
 namespace w5n {
 
-Rope::RopeNode::RopeNode() :
-    left(nullptr), right(nullptr), size(0)
-#ifndef W5N_ROPE_UTF8_IGNORE
-    ,
-    charCount(0)
-#endif
-    ,
-    buffer(nullptr)
-{
-}
+namespace {
 
-Rope::RopeNode::RopeNode(std::shared_ptr<const Rope::RopeNode> left_node,
-                         std::shared_ptr<const Rope::RopeNode> right_node) :
-    left(left_node),
-    right(right_node), size(0)
-#ifndef W5N_ROPE_UTF8_IGNORE
-    ,
-    charCount(0)
-#endif
-    ,
-    buffer(nullptr)
+enum class Event
 {
-    if (left_node != nullptr) {
-        size = left_node->size;
-#ifndef W5N_ROPE_UTF8_IGNORE
-        charCount = left_node->charCount;
+    NodeAllocation,
+    BufferAllocation,
+    Split,
+    Concat,
+    Rebalance,
+    Compaction,
+    Segmentation,
+    Count
+};
+
+#ifdef W5N_ROPE_COUNTERS
+#ifdef W5N_ROPE_SINGLE_THREADED
+std::array<size_t, static_cast<size_t>(Event::Count)> events{};
+#else
+std::array<std::atomic<size_t>, static_cast<size_t>(Event::Count)> events{};
+#endif
 #endif
-    }
 
-    if (right_node != nullptr) {
-        size += right_node->size;
-#ifndef W5N_ROPE_UTF8_IGNORE
-        charCount += right_node->charCount;
+// Compiled out unless W5N_ROPE_COUNTERS is set.
+inline void countEvent([[maybe_unused]] Event event)
+{
+#ifdef W5N_ROPE_COUNTERS
+#ifdef W5N_ROPE_SINGLE_THREADED
+    ++events[static_cast<size_t>(event)];
+#else
+    events[static_cast<size_t>(event)].fetch_add(1, std::memory_order_relaxed);
+#endif
 #endif
-    }
 }
 
-Rope::RopeNode::RopeNode(std::string_view value) : Rope::RopeNode()
+// Nodes and buffers count the handles pointing to them, atomically unless W5N_ROPE_SINGLE_THREADED is set.
+template <typename Counter>
+inline void retainReference(Counter& count)
 {
-    const auto sz = value.size();
-    if (sz > 0) {
-        size = sz;
-        buffer = std::make_shared<std::string>(value.data(), value.size());
-#ifndef W5N_ROPE_UTF8_IGNORE
-        auto utf8View = uni::views::grapheme::utf8(value);
-        charCount = std::distance(utf8View.begin(), utf8View.end());
+#ifdef W5N_ROPE_SINGLE_THREADED
+    ++count;
+#else
+    count.fetch_add(1, std::memory_order_relaxed);
 #endif
-    }
 }
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-std::string Rope::RopeNode::at(size_t index) const
+// True when the last reference is gone.
+template <typename Counter>
+inline bool releaseReference(Counter& count)
+{
+#ifdef W5N_ROPE_SINGLE_THREADED
+    return --count == 0;
 #else
-char Rope::RopeNode::at(size_t index) const
+    return count.fetch_sub(1, std::memory_order_acq_rel) == 1;
 #endif
-{
-    if (isLeaf()) {
-#ifndef W5N_ROPE_UTF8_IGNORE
-        if (index >= charCount) {
-            return std::string{};
-        }
-
-        using uni::views::drop;
-        using uni::views::take;
-
-        auto utf8View = uni::views::grapheme::utf8(*buffer);
+}
 
-        auto begin = std::next(utf8View.begin(), index).begin();
-        auto end = std::next(utf8View.begin(), index + 1).begin();
+// A serialized rope is SERIALIZATION_MAGIC and SERIALIZATION_VERSION followed by:
+//   flags                  SERIALIZED_GRAPHEMES or SERIALIZED_CODE_POINTS when grapheme or code point counts were
+//                          stored, 0 for a rope counting bytes
+//   text size, text        the text of every leaf, in order
+//   tree size, tree        every node in pre-order: its child count (0 for a leaf), then for a leaf its size and
+//                          whether its counts follow. Those are its line breaks and, unless the flags are 0, its
+//                          character count and checkpoints (their count, then each index and offset as the difference
+//                          from the previous one).
+// Sizes and counts are unsigned LEB128, the flags and version a single byte.
+constexpr std::string_view SERIALIZATION_MAGIC = "W5NR";
+constexpr uint8_t SERIALIZATION_VERSION = 1;
+constexpr uint8_t SERIALIZED_GRAPHEMES = 1;
+constexpr uint8_t SERIALIZED_CODE_POINTS = 2;
+
+template <typename Unit>
+constexpr uint8_t serializedCounts()
+{
+    if constexpr (std::same_as<Unit, metrics::Graphemes>) {
+        return SERIALIZED_GRAPHEMES;
+    } else if constexpr (std::same_as<Unit, metrics::CodePoints>) {
+        return SERIALIZED_CODE_POINTS;
+    } else {
+        return 0;
+    }
+}
 
-        return std::string{begin, end};
-#else
-        if (index >= size) {
-            return '\0';
-        }
+// Deeper trees than this would not fit in memory, so a tree claiming to be deeper is corrupted.
+constexpr size_t MAX_SERIALIZED_DEPTH = 32;
 
-        return (*buffer)[index];
-#endif
+void writeVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
     }
 
-    if (index < weight()) {
-        return left->at(index);
-    } else {
-        return right->at(index - weight());
-    }
+    out += static_cast<char>(value);
 }
 
-std::pair<std::shared_ptr<const Rope::RopeNode>, std::shared_ptr<const Rope::RopeNode>> Rope::RopeNode::split(
-    size_t index) const
+std::optional<uint64_t> readVarint(std::istream& stream)
 {
-    if (isLeaf()) {
-        if (buffer == nullptr) {
-            return {std::make_shared<const Rope::RopeNode>(std::string_view{}),
-                    std::make_shared<const Rope::RopeNode>(std::string_view{})};
-        }
+    uint64_t value = 0;
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-        if (index > charCount) {
-            index = charCount;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        const auto byte = stream.get();
+
+        if (byte == std::char_traits<char>::eof()) {
+            return std::nullopt;
         }
-#else
-        if (index > buffer->size()) {
-            index = buffer->size();
+
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0) {
+            return value;
         }
+    }
 
-#endif
+    return std::nullopt;
+}
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-        auto utf8View = uni::views::grapheme::utf8(*buffer);
+// Reads size bytes into out. Unless the stream tells there are that many bytes left, out only grows with what was
+// actually read, so a corrupted size fails at the end of the stream instead of allocating that much up front.
+template <typename String>
+bool readBytes(std::istream& stream, size_t size, String& out)
+{
+    constexpr size_t CHUNK_SIZE = 1 << 20;
+    const auto start = stream.tellg();
 
-        auto begin_first = std::begin(*buffer);
-        auto end_first = std::next(utf8View.begin(), index).begin();
-        auto begin_second = end_first;
-        auto end_second = std::end(*buffer);
-#else
-        auto begin_first = std::begin(*buffer);
-        auto end_first = begin_first + index;
-        auto begin_second = end_first;
-        auto end_second = std::end(*buffer);
-#endif
+    if (start != std::istream::pos_type(-1) && stream.seekg(0, std::ios::end)) {
+        const auto available = static_cast<size_t>(stream.tellg() - start);
+        stream.seekg(start);
 
-        auto test = std::make_shared<const Rope::RopeNode>(std::string_view{begin_second, end_second});
+        if (available < size) {
+            return false;
+        }
 
-        return {std::make_shared<const Rope::RopeNode>(std::string_view{begin_first, end_first}),
-                std::make_shared<const Rope::RopeNode>(std::string_view{begin_second, end_second})};
+        out.reserve(size);
     }
 
-    if (index < weight()) {
-        auto parts = left->split(index);
+    stream.clear(stream.rdstate() & ~std::ios::failbit);
 
-        return {parts.first, std::make_shared<const Rope::RopeNode>(parts.second, right)};
-    } else if (index > weight()) {
-        auto parts = right->split(index - weight());
+    while (out.size() < size) {
+        const auto offset = out.size();
+        const auto chunk = std::min(CHUNK_SIZE, size - offset);
+        out.resize(offset + chunk);
 
-        return {std::make_shared<const Rope::RopeNode>(left, parts.first), parts.second};
+        if (!stream.read(out.data() + offset, static_cast<std::streamsize>(chunk))) {
+            return false;
+        }
     }
 
-    return {left, right};
+    return true;
 }
 
-size_t Rope::RopeNode::weight() const
+// Splits text into the characters a rope counts. forEachStart calls visit with the byte offset each one starts at,
+// until it returns false, and isBoundary tells whether an offset inside the text starts one when the bytes around it
+// are enough to know.
+template <typename Unit>
+struct Segmenter;
+
+template <>
+struct Segmenter<metrics::CodePoints>
 {
-    if (isLeaf()) {
-#ifndef W5N_ROPE_UTF8_IGNORE
-        return charCount;
-#else
-        return size;
-#endif
+    static bool isContinuation(char byte)
+    {
+        return (static_cast<unsigned char>(byte) & 0xC0) == 0x80;
     }
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-    return left->charCount;
-#else
-    return left->size;
-#endif
-}
-
-size_t Rope::RopeNode::depth() const
-{
-    std::stack<const Rope::RopeNode*> queue;
-    std::stack<const Rope::RopeNode*> path;
+    template <typename Visitor>
+    static void forEachStart(std::string_view text, Visitor visit)
+    {
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (!isContinuation(text[i]) && !visit(i)) {
+                return;
+            }
+        }
+    }
 
-    size_t depth = 0;
-    queue.emplace(this);
+    static size_t charSize(std::string_view text)
+    {
+        size_t size = 1;
 
-    while (!queue.empty()) {
-        auto r = queue.top();
+        while (size < text.size() && isContinuation(text[size])) {
+            ++size;
+        }
 
-        if (!path.empty() && r == path.top()) {
-            if (path.size() > depth) {
-                depth = path.size();
-            }
+        return std::min(size, text.size());
+    }
 
-            path.pop();
-            queue.pop();
-        } else {
-            path.emplace(r);
+    static std::optional<bool> isBoundary(std::string_view text, size_t offset)
+    {
+        return !isContinuation(text[offset]);
+    }
 
-            if (r->left != nullptr) {
-                queue.emplace(&*r->left);
-            }
+    static size_t windowStart(std::string_view, size_t offset, size_t)
+    {
+        return offset;
+    }
+};
 
-            if (r->right != nullptr) {
-                queue.emplace(&*r->right);
+#ifndef W5N_ROPE_UTF8_IGNORE
+template <>
+struct Segmenter<metrics::Graphemes>
+{
+    template <typename Visitor>
+    static void forEachStart(std::string_view text, Visitor visit)
+    {
+        auto utf8View = uni::views::grapheme::utf8(text);
+
+        for (auto it = utf8View.begin(); it != utf8View.end(); ++it) {
+            if (!visit(static_cast<size_t>(std::distance(text.begin(), it.begin())))) {
+                return;
             }
         }
     }
 
-    return depth;
-}
-
-std::vector<std::shared_ptr<const Rope::RopeNode>> Rope::RopeNode::collectLeaves() const
-{
-    std::vector<std::shared_ptr<const Rope::RopeNode>> children;
-    std::stack<std::shared_ptr<const Rope::RopeNode>> nodes;
+    static size_t charSize(std::string_view text)
+    {
+        auto grapheme = uni::views::grapheme::utf8(text).begin();
 
-    nodes.push(shared_from_this());
+        return static_cast<size_t>(std::distance(grapheme.begin(), grapheme.end()));
+    }
 
-    while (nodes.size() > 0) {
-        auto node = nodes.top();
-        nodes.pop();
+    // two ASCII characters other than "\r\n" are always in different graphemes, no need to segment the text
+    static std::optional<bool> isBoundary(std::string_view text, size_t offset)
+    {
+        const auto before = static_cast<unsigned char>(text[offset - 1]);
+        const auto after = static_cast<unsigned char>(text[offset]);
 
-        if (node->isLeaf()) {
-            if (node->buffer != nullptr) {
-                children.push_back(node);
-            }
-            continue;
+        if (before < 0x80 && after < 0x80) {
+            return before != '\r' || after != '\n';
         }
 
-        if (node->right != nullptr) {
-            nodes.push(node->right);
+        return std::nullopt;
+    }
+
+    // Regional indicators pair up into flags counting from the first one of their run, so segmenting from the middle
+    // of a run can pair every one of them the wrong way. The window is moved back to the start of the code point and
+    // of the run of regional indicators offset is in, but not before limit, which is a boundary.
+    static size_t windowStart(std::string_view text, size_t offset, size_t limit)
+    {
+        // U+1F1E6 to U+1F1FF
+        auto isRegionalIndicator = [text](size_t at) {
+            return text.substr(at, 3) == "\xF0\x9F\x87" && static_cast<unsigned char>(text[at + 3]) >= 0xA6 &&
+                   static_cast<unsigned char>(text[at + 3]) <= 0xBF;
+        };
+
+        while (offset > limit && Segmenter<metrics::CodePoints>::isContinuation(text[offset])) {
+            --offset;
         }
 
-        if (node->left != nullptr) {
-            nodes.push(node->left);
+        while (offset >= limit + 4 && isRegionalIndicator(offset - 4)) {
+            offset -= 4;
         }
+
+        return offset;
     }
+};
+#endif
 
-    return children;
+} // namespace
+
+template <RopeUnit Unit>
+template <typename... Args>
+auto BasicRope<Unit>::allocateNode(std::pmr::memory_resource* resource, Args&&... args) -> NodePtr
+{
+    std::pmr::polymorphic_allocator<RopeNode> allocator{resource};
+    auto node = allocator.allocate(1);
+
+    try {
+        new (node) RopeNode(std::forward<Args>(args)...);
+    } catch (...) {
+        allocator.deallocate(node, 1);
+        throw;
+    }
+
+    node->resource = resource;
+    countEvent(Event::NodeAllocation);
+
+    return NodePtr{node};
 }
 
-bool Rope::RopeNode::isLeaf() const
+template <RopeUnit Unit>
+template <typename... Args>
+auto BasicRope<Unit>::allocateBuffer(std::pmr::memory_resource* resource, Args&&... args) -> BufferPtr
 {
-    return left == nullptr && right == nullptr;
+    std::pmr::polymorphic_allocator<LeafBuffer> allocator{resource};
+    auto buffer = allocator.allocate(1);
+
+    try {
+        new (buffer) LeafBuffer(std::forward<Args>(args)...);
+    } catch (...) {
+        allocator.deallocate(buffer, 1);
+        throw;
+    }
+
+    buffer->resource = resource;
+    countEvent(Event::BufferAllocation);
+
+    return BufferPtr{buffer};
 }
 
-std::string Rope::RopeNode::toString() const
+template <RopeUnit Unit>
+BasicRope<Unit>::NodePtr::NodePtr(std::nullptr_t) : node(nullptr)
 {
-    std::stringstream stream;
-    auto nodes = collectLeaves();
+}
 
-    std::for_each(std::begin(nodes), std::end(nodes), [&stream](const auto node) {
-        if (node->size > 0 && node->buffer != nullptr) {
-            std::string tmp{std::begin(*node->buffer), std::end(*node->buffer)};
-            stream << tmp;
-        }
-    });
+template <RopeUnit Unit>
+BasicRope<Unit>::NodePtr::NodePtr() : node(nullptr)
+{
+}
 
-    return stream.str();
+template <RopeUnit Unit>
+BasicRope<Unit>::NodePtr::NodePtr(const RopeNode* node) : node(node)
+{
+    retain();
 }
 
-Rope::Rope() : root(std::make_shared<const Rope::RopeNode>())
+template <RopeUnit Unit>
+BasicRope<Unit>::NodePtr::NodePtr(const NodePtr& other) : node(other.node)
 {
+    retain();
 }
 
-Rope::~Rope()
+template <RopeUnit Unit>
+BasicRope<Unit>::NodePtr::NodePtr(NodePtr&& other) noexcept : node(std::exchange(other.node, nullptr))
 {
-    std::stack<std::shared_ptr<const Rope::RopeNode>> queue;
-    std::stack<std::shared_ptr<const Rope::RopeNode>> path;
+}
 
-    queue.emplace(root);
+template <RopeUnit Unit>
+auto BasicRope<Unit>::NodePtr::operator=(const NodePtr& other) -> NodePtr&
+{
+    // other may be owned by what this handle points to, and released with it
+    const auto* target = other.node;
+    other.retain();
+    release();
+    node = target;
 
-    while (!queue.empty()) {
-        auto r = queue.top();
+    return *this;
+}
 
-        if (!path.empty() && r == path.top()) {
-            // all children processed
-            path.pop();
-            queue.pop();
+template <RopeUnit Unit>
+auto BasicRope<Unit>::NodePtr::operator=(NodePtr&& other) noexcept -> NodePtr&
+{
+    // taken out of other first, like in the copy assignment, as other may be owned by what this handle points to
+    auto* target = std::exchange(other.node, nullptr);
+    release();
+    node = target;
 
-            // 2 = on the tree and on the r variable only
-            if (r.use_count() > 2) {
-                continue;
-            }
+    return *this;
+}
 
-            auto node = const_cast<Rope::RopeNode*>(r.get());
+template <RopeUnit Unit>
+BasicRope<Unit>::NodePtr::~NodePtr()
+{
+    release();
+}
 
-            if (node->left.use_count() <= 1) {
-                node->left.reset();
-            }
+template <RopeUnit Unit>
+auto BasicRope<Unit>::NodePtr::get() const -> const RopeNode*
+{
+    return node;
+}
 
-            if (node->right.use_count() <= 1) {
-                node->right.reset();
-            }
+template <RopeUnit Unit>
+auto BasicRope<Unit>::NodePtr::operator->() const -> const RopeNode*
+{
+    return node;
+}
 
-            r.reset();
-        } else {
-            path.emplace(r);
+template <RopeUnit Unit>
+auto BasicRope<Unit>::NodePtr::operator*() const -> const RopeNode&
+{
+    return *node;
+}
 
-            if (r->right != nullptr) {
-                queue.emplace(r->right);
-            }
+template <RopeUnit Unit>
+BasicRope<Unit>::NodePtr::operator bool() const
+{
+    return node != nullptr;
+}
 
-            if (r->left != nullptr) {
-                queue.emplace(r->left);
-            }
-        }
-    }
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::NodePtr::useCount() const
+{
+    return node == nullptr ? 0 : static_cast<size_t>(node->refCount);
+}
 
-    root = nullptr;
+template <RopeUnit Unit>
+void BasicRope<Unit>::NodePtr::retain() const
+{
+    if (node != nullptr) {
+        retainReference(node->refCount);
+    }
 }
 
-void Rope::rebalance()
+template <RopeUnit Unit>
+void BasicRope<Unit>::NodePtr::release()
 {
-    if (isBalanced()) {
+    if (node == nullptr) {
         return;
     }
 
-    auto leaves = root->collectLeaves();
-    root = doMerge(leaves, 0, leaves.size());
+    if (releaseReference(node->refCount)) {
+        auto dead = const_cast<RopeNode*>(node);
+        std::pmr::polymorphic_allocator<RopeNode> allocator{dead->resource};
+
+        dead->~RopeNode();
+        allocator.deallocate(dead, 1);
+    }
+
+    node = nullptr;
 }
 
-bool Rope::isBalanced() const
+template <RopeUnit Unit>
+BasicRope<Unit>::BufferPtr::BufferPtr(std::nullptr_t) : buffer(nullptr)
 {
-    return isBalanced(root);
 }
 
-void Rope::append(std::string_view content)
+template <RopeUnit Unit>
+BasicRope<Unit>::BufferPtr::BufferPtr() : buffer(nullptr)
 {
-    root = concat(root, std::make_shared<const Rope::RopeNode>(content));
 }
 
-void Rope::prepend(std::string_view content)
+template <RopeUnit Unit>
+BasicRope<Unit>::BufferPtr::BufferPtr(const LeafBuffer* buffer) : buffer(buffer)
 {
-    root = concat(std::make_shared<const Rope::RopeNode>(content), root);
+    retain();
 }
 
-void Rope::clear()
+template <RopeUnit Unit>
+BasicRope<Unit>::BufferPtr::BufferPtr(const BufferPtr& other) : buffer(other.buffer)
 {
-    root = std::make_shared<const Rope::RopeNode>();
+    retain();
 }
 
-bool Rope::insert(size_t position, std::string_view content)
+template <RopeUnit Unit>
+BasicRope<Unit>::BufferPtr::BufferPtr(BufferPtr&& other) noexcept : buffer(std::exchange(other.buffer, nullptr))
 {
-    if (position == 0) {
-        prepend(content);
+}
 
-        return true;
-    }
+template <RopeUnit Unit>
+auto BasicRope<Unit>::BufferPtr::operator=(const BufferPtr& other) -> BufferPtr&
+{
+    // other may be owned by what this handle points to, and released with it
+    const auto* target = other.buffer;
+    other.retain();
+    release();
+    buffer = target;
 
-    auto sz = size();
+    return *this;
+}
 
-    if (position == sz) {
-        append(content);
+template <RopeUnit Unit>
+auto BasicRope<Unit>::BufferPtr::operator=(BufferPtr&& other) noexcept -> BufferPtr&
+{
+    // taken out of other first, like in the copy assignment, as other may be owned by what this handle points to
+    auto* target = std::exchange(other.buffer, nullptr);
+    release();
+    buffer = target;
 
-        return true;
-    } else if (position > sz) {
-        return false;
-    }
+    return *this;
+}
 
-    auto parts = split(position);
+template <RopeUnit Unit>
+BasicRope<Unit>::BufferPtr::~BufferPtr()
+{
+    release();
+}
 
-    root = concat(concat(parts.first, std::make_shared<const Rope::RopeNode>(content)), parts.second);
+template <RopeUnit Unit>
+auto BasicRope<Unit>::BufferPtr::get() const -> const LeafBuffer*
+{
+    return buffer;
+}
 
-    return true;
+template <RopeUnit Unit>
+auto BasicRope<Unit>::BufferPtr::operator->() const -> const LeafBuffer*
+{
+    return buffer;
 }
 
-bool Rope::erase(size_t position, size_t size)
+template <RopeUnit Unit>
+auto BasicRope<Unit>::BufferPtr::operator*() const -> const LeafBuffer&
 {
-    if (size == 0) {
-        return false;
+    return *buffer;
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::BufferPtr::operator bool() const
+{
+    return buffer != nullptr;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::BufferPtr::useCount() const
+{
+    return buffer == nullptr ? 0 : static_cast<size_t>(buffer->refCount);
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::BufferPtr::retain() const
+{
+    if (buffer != nullptr) {
+        retainReference(buffer->refCount);
+    }
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::BufferPtr::release()
+{
+    if (buffer == nullptr) {
+        return;
     }
 
-    auto parts = split(position);
-    auto to_remove_parts = split(position + size);
+    if (releaseReference(buffer->refCount)) {
+        auto dead = const_cast<LeafBuffer*>(buffer);
+        std::pmr::polymorphic_allocator<LeafBuffer> allocator{dead->resource};
 
-    root = concat(parts.first, to_remove_parts.second);
+        dead->~LeafBuffer();
+        allocator.deallocate(dead, 1);
+    }
 
-    return true;
+    buffer = nullptr;
 }
 
-std::string Rope::toString() const
+template <RopeUnit Unit>
+BasicRope<Unit>::LeafBuffer::LeafBuffer(std::string_view value, std::pmr::memory_resource* resource) :
+    refCount(0), resource(resource), storage(value, resource), text(storage), mapping(nullptr), liveBytes(0)
 {
-    return root->toString();
 }
 
-std::string Rope::substring(size_t from) const
+template <RopeUnit Unit>
+BasicRope<Unit>::LeafBuffer::LeafBuffer(size_t capacity, std::pmr::memory_resource* resource) :
+    refCount(0), resource(resource), storage(capacity, '\0', resource), text(storage), mapping(nullptr), liveBytes(0)
 {
-    auto parts = split(from);
+}
 
-    return parts.second->toString();
+template <RopeUnit Unit>
+BasicRope<Unit>::LeafBuffer::LeafBuffer(std::pmr::string&& value) :
+    refCount(0), resource(value.get_allocator().resource()), storage(std::move(value)), text(storage), mapping(nullptr),
+    liveBytes(0)
+{
 }
 
-std::string Rope::substring(size_t from, size_t size) const
+template <RopeUnit Unit>
+BasicRope<Unit>::LeafBuffer::LeafBuffer(void* mapped_file, size_t mapped_size) :
+    refCount(0), resource(nullptr), text(static_cast<const char*>(mapped_file), mapped_size), mapping(mapped_file),
+    liveBytes(0)
 {
-    auto begin_parts = split(from);
-    auto range = begin_parts.second->split(size);
+}
 
-    return range.first->toString();
+template <RopeUnit Unit>
+BasicRope<Unit>::LeafBuffer::~LeafBuffer()
+{
+#ifndef _WIN32
+    if (mapping != nullptr) {
+        ::munmap(mapping, text.size());
+    }
+#endif
 }
 
-size_t Rope::size() const
+template <RopeUnit Unit>
+BasicRope<Unit>::RopeNode::RopeNode() : RopeNode(std::pmr::get_default_resource())
 {
-    return root->size;
 }
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-size_t Rope::charCount() const
+template <RopeUnit Unit>
+BasicRope<Unit>::RopeNode::RopeNode(std::pmr::memory_resource* resource) :
+    refCount(0), resource(resource), childCount(0), height(0), size(0), buffer(nullptr), offset(0),
+    charsState(MetricsState::Ready), chars(resource), linesState(MetricsState::Ready), lineBreaks(0)
 {
-    return root->charCount;
 }
-#endif
 
-#ifndef W5N_ROPE_UTF8_IGNORE
-const std::string Rope::at(size_t index) const
-#else
-char Rope::at(size_t index) const
-#endif
+template <RopeUnit Unit>
+BasicRope<Unit>::RopeNode::RopeNode(std::span<const NodePtr> child_nodes) : RopeNode()
 {
-    return root->at(index);
+    childCount = child_nodes.size();
+    height = child_nodes.front()->height + 1;
+    charsState = MetricsState::Pending;
+    linesState = MetricsState::Pending;
+
+    for (size_t i = 0; i < childCount; ++i) {
+        children[i] = child_nodes[i];
+        size += child_nodes[i]->size;
+    }
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::RopeNode::RopeNode(std::string_view value, std::pmr::memory_resource* resource) :
+    RopeNode(makeBuffer(value, resource), 0, value.size(), resource)
+{
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::RopeNode::RopeNode(BufferPtr leaf_buffer,
+                                    size_t leaf_offset,
+                                    size_t leaf_size,
+                                    std::pmr::memory_resource* resource) :
+    RopeNode(resource)
+{
+    if (leaf_size > 0) {
+        size = leaf_size;
+        offset = leaf_offset;
+        buffer = std::move(leaf_buffer);
+        buffer->liveBytes += size;
+        charsState = MetricsState::Pending;
+        linesState = MetricsState::Pending;
+    }
 }
 
-Rope::Rope(std::shared_ptr<const Rope::RopeNode> r) : root(r)
+template <RopeUnit Unit>
+BasicRope<Unit>::RopeNode::RopeNode(BufferPtr leaf_buffer,
+                                    size_t leaf_offset,
+                                    size_t leaf_size,
+                                    size_t char_count,
+                                    std::span<const Checkpoint> checkpoints,
+                                    std::pmr::memory_resource* resource)
+    requires(Unit::counted)
+    : RopeNode(resource)
 {
+    if (leaf_size > 0) {
+        size = leaf_size;
+        offset = leaf_offset;
+        chars.count = char_count;
+        buffer = std::move(leaf_buffer);
+        buffer->liveBytes += size;
+        lineBreaks = countLineBreaks(text());
+        chars.checkpoints.assign(checkpoints.begin(), checkpoints.end());
+    }
 }
 
-std::pair<std::shared_ptr<const Rope::RopeNode>, std::shared_ptr<const Rope::RopeNode>> Rope::split(size_t index) const
+template <RopeUnit Unit>
+BasicRope<Unit>::RopeNode::~RopeNode()
 {
-    return root->split(index);
+    if (buffer != nullptr) {
+        buffer->liveBytes -= size;
+    }
 }
 
-std::shared_ptr<const Rope::RopeNode> Rope::concat(std::shared_ptr<const Rope::RopeNode> left,
-                                                   std::shared_ptr<const Rope::RopeNode> right) const
+template <RopeUnit Unit>
+auto BasicRope<Unit>::RopeNode::at(size_t index) const -> CharType
 {
-    return std::make_shared<const Rope::RopeNode>(left, right);
+    if (isLeaf()) {
+        if (index >= measure(Metric::Chars)) {
+            return CharType{};
+        }
+
+        if constexpr (Unit::counted) {
+            auto [begin, end] = charBounds(index);
+
+            return std::string{text().substr(begin, end - begin)};
+        } else {
+            return text()[index];
+        }
+    }
+
+    for (const auto& child : childNodes()) {
+        const auto child_weight = child->measure(Metric::Chars);
+
+        if (index < child_weight) {
+            return child->at(index);
+        }
+
+        index -= child_weight;
+    }
+
+    return CharType{};
 }
 
-bool Rope::isBalanced(std::shared_ptr<const Rope::RopeNode> node) const
+template <RopeUnit Unit>
+auto BasicRope<Unit>::RopeNode::split(size_t index,
+                                       Metric metric,
+                                       std::pmr::memory_resource* resource) const -> std::pair<NodePtr, NodePtr>
 {
-    long long left_depth = node->left == nullptr ? 0 : node->left->depth();
-    long long right_depth = node->right == nullptr ? 0 : node->right->depth();
+    if (index == 0) {
+        return {makeNode({}, resource), NodePtr{this}};
+    }
+
+    if (index >= measure(metric)) {
+        return {NodePtr{this}, makeNode({}, resource)};
+    }
+
+    if (isLeaf()) {
+        if (metric == Metric::Chars) {
+            return splitLeaf(charBounds(index).first, index, resource);
+        }
+
+        return splitLeaf(index, hasCharCounts() ? charsBefore(index) : std::string::npos, resource);
+    }
 
-    return std::abs(left_depth - right_depth) <= 2;
+    auto nodes = childNodes();
+    size_t offset = 0;
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto child_weight = nodes[i]->measure(metric);
+
+        if (index == offset) {
+            return {makeNode(nodes.first(i), resource), makeNode(nodes.subspan(i), resource)};
+        }
+
+        if (index < offset + child_weight) {
+            auto parts = nodes[i]->split(index - offset, metric, resource);
+
+            return {concat(makeNode(nodes.first(i), resource), parts.first, resource),
+                    concat(parts.second, makeNode(nodes.subspan(i + 1), resource), resource)};
+        }
+
+        offset += child_weight;
+    }
+
+    return {NodePtr{this}, makeNode({}, resource)};
 }
 
-std::shared_ptr<const Rope::RopeNode> Rope::doMerge(const std::vector<std::shared_ptr<const Rope::RopeNode>>& leaves,
-                                                    size_t start,
-                                                    size_t end) const
+template <RopeUnit Unit>
+auto BasicRope<Unit>::RopeNode::splitLeaf(size_t offset,
+                                           [[maybe_unused]] size_t index,
+                                           std::pmr::memory_resource* resource) const -> std::pair<NodePtr, NodePtr>
 {
-    auto range = end - start;
+    // both halves keep pointing into the same buffer, unless it has to be compacted
+    auto source = isBufferSparse() ? makeBuffer(text(), resource) : buffer;
+    auto source_offset = source == buffer ? this->offset : 0;
+    countEvent(Event::Split);
+
+    if (source != buffer) {
+        countEvent(Event::Compaction);
+    }
+
+    if constexpr (Unit::counted) {
+        // the checkpoints are shared between both halves, the second one starting over from its first character
+        if (index != std::string::npos && hasCharCounts()) {
+            auto middle = std::lower_bound(
+                chars.checkpoints.begin(), chars.checkpoints.end(), index, [](const auto& checkpoint, size_t value) {
+                    return checkpoint.index < value;
+                });
+
+            std::vector<Checkpoint> left_index{chars.checkpoints.begin(), middle};
+            std::vector<Checkpoint> right_index{{0, 0}};
+
+            for (auto it = middle; it != chars.checkpoints.end(); ++it) {
+                if (it->index > index) {
+                    right_index.push_back(
+                        {static_cast<uint32_t>(it->index - index), static_cast<uint32_t>(it->offset - offset)});
+                }
+            }
+
+            return {allocateNode(resource, source, source_offset, offset, index, left_index, resource),
+                    allocateNode(resource,
+                                 source,
+                                 source_offset + offset,
+                                 size - offset,
+                                 chars.count - index,
+                                 right_index,
+                                 resource)};
+        }
+    }
 
-    if (range <= 1) {
-        return leaves[start];
+    // not on a boundary (or not segmented yet), so both halves will have to be segmented on their own
+    return {allocateNode(resource, source, source_offset, offset, resource),
+            allocateNode(resource, source, source_offset + offset, size - offset, resource)};
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::RopeNode::copyBytes(size_t offset, size_t size, char* out) const
+{
+    if (size == 0) {
+        return;
     }
 
-    if (range == 2) {
-        return concat(leaves[start], leaves[start + 1]);
+    if (isLeaf()) {
+        std::copy_n(text().data() + offset, size, out);
+
+        return;
     }
 
-    auto mid = start + range / 2;
+    for (const auto& child : childNodes()) {
+        if (offset >= child->size) {
+            offset -= child->size;
+            continue;
+        }
+
+        const auto count = std::min(size, child->size - offset);
+        child->copyBytes(offset, count, out);
+
+        out += count;
+        size -= count;
+        offset = 0;
 
-    return concat(doMerge(leaves, start, mid), doMerge(leaves, mid, end));
+        if (size == 0) {
+            break;
+        }
+    }
 }
 
+template <RopeUnit Unit>
+std::optional<std::string_view> BasicRope<Unit>::RopeNode::view(size_t offset, size_t size) const
+{
+    if (isLeaf()) {
+        if (offset + size > this->size) {
+            return std::nullopt;
+        }
+
+        return text().substr(offset, size);
+    }
+
+    for (const auto& child : childNodes()) {
+        if (offset < child->size) {
+            return child->view(offset, size);
+        }
+
+        offset -= child->size;
+    }
+
+    return std::nullopt;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::RopeNode::byteOffset(size_t index) const
+{
+    if (isLeaf()) {
+        return index < measure(Metric::Chars) ? charBounds(index).first : size;
+    }
+
+    size_t offset = 0;
+
+    for (const auto& child : childNodes()) {
+        const auto child_weight = child->measure(Metric::Chars);
+
+        if (index < child_weight) {
+            return offset + child->byteOffset(index);
+        }
+
+        index -= child_weight;
+        offset += child->size;
+    }
+
+    return size;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::RopeNode::lineBreakOffset(size_t line_break) const
+{
+    if (isLeaf()) {
+        auto value = text();
+        size_t offset = value.find('\n');
+
+        for (; line_break > 0 && offset != std::string::npos; --line_break) {
+            offset = value.find('\n', offset + 1);
+        }
+
+        return offset;
+    }
+
+    size_t offset = 0;
+
+    for (const auto& child : childNodes()) {
+        const auto child_weight = child->measure(Metric::Lines);
+
+        if (line_break < child_weight) {
+            return offset + child->lineBreakOffset(line_break);
+        }
+
+        line_break -= child_weight;
+        offset += child->size;
+    }
+
+    return std::string::npos;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::RopeNode::lineBreaksBefore(size_t offset) const
+{
+    if (isLeaf()) {
+        return countLineBreaks(text().substr(0, offset));
+    }
+
+    size_t count = 0;
+
+    for (const auto& child : childNodes()) {
+        if (offset < child->size) {
+            return count + child->lineBreaksBefore(offset);
+        }
+
+        offset -= child->size;
+        count += child->measure(Metric::Lines);
+    }
+
+    return count;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::RopeNode::isCharBoundary(size_t offset) const
+{
+    if (isLeaf()) {
+        if constexpr (Unit::counted) {
+            if (offset == 0 || offset >= size) {
+                return true;
+            }
+
+            if (auto boundary = Segmenter<Unit>::isBoundary(text(), offset)) {
+                return *boundary;
+            }
+
+            return charsBefore(offset) != std::string::npos;
+        } else {
+            return true;
+        }
+    }
+
+    for (const auto& child : childNodes()) {
+        if (offset < child->size) {
+            return child->isCharBoundary(offset);
+        }
+
+        offset -= child->size;
+    }
+
+    return true;
+}
+
+template <RopeUnit Unit>
+std::pair<size_t, size_t> BasicRope<Unit>::RopeNode::charBounds(size_t index) const
+{
+    if constexpr (Unit::counted) {
+        computeChars();
+
+        auto checkpoint = std::prev(std::upper_bound(
+            chars.checkpoints.begin(), chars.checkpoints.end(), index, [](size_t value, const auto& checkpoint) {
+                return value < checkpoint.index;
+            }));
+
+        // the character ends where the next one starts, or with the leaf
+        auto text = this->text().substr(checkpoint->offset);
+        const size_t target = index - checkpoint->index;
+        size_t count = 0;
+        size_t first = text.size();
+        size_t last = text.size();
+
+        Segmenter<Unit>::forEachStart(text, [&](size_t start) {
+            if (count == target) {
+                first = start;
+            } else if (count > target) {
+                last = start;
+                return false;
+            }
+
+            ++count;
+            return true;
+        });
+
+        return {checkpoint->offset + first, checkpoint->offset + last};
+    } else {
+        return {index, index + 1};
+    }
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::RopeNode::charsBefore(size_t offset) const
+{
+    if constexpr (Unit::counted) {
+        computeChars();
+
+        if (offset >= size) {
+            return chars.count;
+        }
+
+        auto checkpoint = std::prev(std::upper_bound(
+            chars.checkpoints.begin(), chars.checkpoints.end(), offset, [](size_t value, const auto& checkpoint) {
+                return value < checkpoint.offset;
+            }));
+
+        const size_t target = offset - checkpoint->offset;
+        size_t index = checkpoint->index;
+        size_t result = std::string::npos;
+
+        Segmenter<Unit>::forEachStart(this->text().substr(checkpoint->offset), [&](size_t start) {
+            if (start >= target) {
+                result = start == target ? index : std::string::npos;
+                return false;
+            }
+
+            ++index;
+            return true;
+        });
+
+        return result;
+    } else {
+        return std::min(offset, size);
+    }
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::RopeNode::measure(Metric metric) const
+{
+    // characters are bytes in a rope that does not count anything else, nothing to compute for them
+    if (metric == Metric::Bytes || (metric == Metric::Chars && !Unit::counted)) {
+        return size;
+    }
+
+    if constexpr (Unit::counted) {
+        if (metric == Metric::Chars) {
+            computeChars();
+            return chars.count;
+        }
+    }
+
+    computeLineBreaks();
+
+    return lineBreaks;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::RopeNode::hasMetrics() const
+{
+    return linesState == MetricsState::Ready && (!Unit::counted || hasCharCounts());
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::RopeNode::hasCharCounts() const
+{
+    return charsState == MetricsState::Ready;
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::RopeNode::computeMetrics() const
+{
+    computeLineBreaks();
+
+    if constexpr (Unit::counted) {
+        computeChars();
+    }
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::RopeNode::computeLineBreaks() const
+{
+    computeOnce(linesState, [this]() {
+        fillLineBreaks();
+    });
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::RopeNode::computeChars() const
+{
+    computeOnce(charsState, [this]() {
+        fillChars();
+    });
+}
+
+template <RopeUnit Unit>
+template <typename Fill>
+void BasicRope<Unit>::RopeNode::computeOnce(MetricsFlag& state, Fill fill)
+{
+#ifdef W5N_ROPE_SINGLE_THREADED
+    if (state != MetricsState::Ready) {
+        fill();
+        state = MetricsState::Ready;
+    }
+#else
+    auto current = state.load(std::memory_order_acquire);
+
+    if (current == MetricsState::Ready) {
+        return;
+    }
+
+    // one thread fills them in, the others wait for it to be done
+    current = MetricsState::Pending;
+
+    if (state.compare_exchange_strong(current, MetricsState::Computing, std::memory_order_acquire)) {
+        fill();
+        state.store(MetricsState::Ready, std::memory_order_release);
+        state.notify_all();
+
+        return;
+    }
+
+    while (current != MetricsState::Ready) {
+        state.wait(current, std::memory_order_acquire);
+        current = state.load(std::memory_order_acquire);
+    }
+#endif
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::RopeNode::fillLineBreaks() const
+{
+    if (isLeaf()) {
+        lineBreaks = countLineBreaks(text());
+        return;
+    }
+
+    lineBreaks = 0;
+
+    for (const auto& child : childNodes()) {
+        lineBreaks += child->measure(Metric::Lines);
+    }
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::RopeNode::fillChars() const
+{
+    if constexpr (Unit::counted) {
+        size_t count = 0;
+
+        if (!isLeaf()) {
+            for (const auto& child : childNodes()) {
+                count += child->measure(Metric::Chars);
+            }
+
+            chars.count = count;
+            return;
+        }
+
+        countEvent(Event::Segmentation);
+        chars.checkpoints.clear();
+
+        Segmenter<Unit>::forEachStart(text(), [this, &count](size_t start) {
+            if (count % CHECKPOINT_STEP == 0) {
+                chars.checkpoints.push_back({static_cast<uint32_t>(count), static_cast<uint32_t>(start)});
+            }
+
+            ++count;
+            return true;
+        });
+
+        chars.count = count;
+    }
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::RopeNode::collectLeaves() const -> std::vector<NodePtr>
+{
+    std::vector<NodePtr> children;
+    std::stack<NodePtr> nodes;
+
+    nodes.push(NodePtr{this});
+
+    while (nodes.size() > 0) {
+        auto node = nodes.top();
+        nodes.pop();
+
+        if (node->isLeaf()) {
+            if (node->size > 0) {
+                children.push_back(node);
+            }
+            continue;
+        }
+
+        auto child_nodes = node->childNodes();
+        std::for_each(std::rbegin(child_nodes), std::rend(child_nodes), [&nodes](const auto& child) {
+            nodes.push(child);
+        });
+    }
+
+    return children;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::RopeNode::isLeaf() const
+{
+    return childCount == 0;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::RopeNode::isUnderfull() const
+{
+    if (isLeaf()) {
+        return size < MIN_LEAF_SIZE;
+    }
+
+    return childCount < MIN_CHILDREN;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::RopeNode::isBufferSparse() const
+{
+    return buffer != nullptr && buffer->text.size() > MAX_LEAF_SIZE &&
+           buffer->liveBytes * BUFFER_COMPACTION_RATIO < buffer->text.size();
+}
+
+template <RopeUnit Unit>
+std::string_view BasicRope<Unit>::RopeNode::text() const
+{
+    if (buffer == nullptr) {
+        return {};
+    }
+
+    return buffer->text.substr(offset, size);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::RopeNode::childNodes() const -> std::span<const NodePtr>
+{
+    return {children.data(), childCount};
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::RopeNode::toString() const
+{
+    std::string result;
+    result.reserve(size);
+
+    Cursor cursor{NodePtr{this}};
+
+    do {
+        result.append(cursor.leaf()->text());
+    } while (cursor.nextLeaf());
+
+    return result;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::RopeNode::memoryUsage() const
+{
+    size_t bytes = sizeof(RopeNode);
+
+    if constexpr (Unit::counted) {
+        if (hasCharCounts()) {
+            bytes += chars.checkpoints.capacity() * sizeof(Checkpoint);
+        }
+    }
+
+    return bytes;
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::BasicRope() : BasicRope(std::pmr::get_default_resource())
+{
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::BasicRope(std::pmr::memory_resource* resource) : root(makeNode({}, resource)), resource(resource)
+{
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::~BasicRope() = default;
+
+template <RopeUnit Unit>
+BasicRope<Unit> BasicRope<Unit>::snapshot() const
+{
+    return *this;
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit> BasicRope<Unit>::fromString(std::string_view content, std::pmr::memory_resource* resource)
+{
+    return BasicRope{makeTree(content, resource), resource};
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit> BasicRope<Unit>::fromChunks(std::span<const std::string_view> chunks,
+                                             std::pmr::memory_resource* resource)
+{
+    auto buffer = joinChunks(chunks, resource);
+
+    if (buffer == nullptr) {
+        return BasicRope{resource};
+    }
+
+    return BasicRope{doMerge(sliceLeaves(buffer, leafBoundaries(buffer->text), resource), resource), resource};
+}
+
+template <RopeUnit Unit>
+std::optional<BasicRope<Unit>> BasicRope<Unit>::fromFile(const std::filesystem::path& path,
+                                                         std::pmr::memory_resource* resource)
+{
+    std::string content;
+
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    struct stat info{};
+
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    if (S_ISREG(info.st_mode)) {
+        const auto size = static_cast<size_t>(info.st_size);
+
+        if (size == 0) {
+            ::close(fd);
+            return BasicRope{resource};
+        }
+
+        void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (mapping == MAP_FAILED) {
+            return std::nullopt;
+        }
+
+        // The leaves are slices of the mapping. Bytes can be cut anywhere without reading the file, but placing a cut
+        // on a grapheme or code point boundary reads the bytes before it, and the cuts are less than a page apart.
+        auto buffer = allocateBuffer(resource, mapping, size);
+        auto boundaries = Unit::counted ? leafBoundaries(buffer->text) : evenBoundaries(size);
+        auto leaves = sliceLeaves(buffer, boundaries, resource);
+
+        return BasicRope{doMerge(std::move(leaves), resource), resource};
+    }
+
+    // pipes and devices cannot be mapped, they are read to the end instead
+    std::array<char, 65536> chunk;
+
+    while (true) {
+        const auto count = ::read(fd, chunk.data(), chunk.size());
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count < 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        content.append(chunk.data(), static_cast<size_t>(count));
+    }
+
+    ::close(fd);
+#else
+    std::ifstream file{path, std::ios::binary};
+
+    if (!file) {
+        return std::nullopt;
+    }
+
+    content.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+
+    if (file.bad()) {
+        return std::nullopt;
+    }
+#endif
+
+    return BasicRope{makeTree(content, resource), resource};
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::rebalance()
+{
+    if (isBalanced()) {
+        return;
+    }
+
+    countEvent(Event::Rebalance);
+    root = doMerge(root->collectLeaves(), resource);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::isBalanced() const
+{
+    return isBalanced(root);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::depth() const
+{
+    return root->height + 1;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::stats() const -> Stats
+{
+    Stats result{};
+    result.depth = depth();
+
+    // A node held by anything else than its parent (or this rope, for the root) is shared, and so is its subtree.
+    // A buffer is exclusive when every reference to it comes from an exclusive leaf.
+    struct BufferUsage
+    {
+        size_t references;
+        size_t useCount;
+    };
+
+    std::unordered_map<const LeafBuffer*, BufferUsage> buffers;
+    std::vector<std::pair<const RopeNode*, bool>> pending{{root.get(), false}};
+
+    while (!pending.empty()) {
+        auto [node, shared] = pending.back();
+        pending.pop_back();
+        shared = shared || node->refCount > 1;
+
+        (shared ? result.sharedBytes : result.exclusiveBytes) += node->memoryUsage();
+        ++result.nodes;
+
+        if (!node->isLeaf()) {
+            for (const auto& child : node->childNodes()) {
+                pending.emplace_back(child.get(), shared);
+            }
+
+            continue;
+        }
+
+        const auto bucket = std::max<size_t>(std::bit_width(node->size), 1) - 1;
+        ++result.leaves;
+        ++result.leafSizes[std::min(bucket, result.leafSizes.size() - 1)];
+
+        if (node->size < RopeNode::MIN_LEAF_SIZE) {
+            ++result.underfullLeaves;
+        }
+
+        if (node->buffer != nullptr) {
+            auto [usage, inserted] = buffers.try_emplace(node->buffer.get(), BufferUsage{0, node->buffer.useCount()});
+            usage->second.references += shared ? 0 : 1;
+        }
+    }
+
+    for (const auto& [buffer, usage] : buffers) {
+        const size_t bytes = sizeof(LeafBuffer) + buffer->storage.capacity();
+        (usage.references == usage.useCount ? result.exclusiveBytes : result.sharedBytes) += bytes;
+
+        if (buffer->mapping != nullptr) {
+            result.mappedBytes += buffer->text.size();
+        }
+
+        const size_t live = buffer->liveBytes;
+        result.unreferencedBytes += buffer->text.size() - std::min(live, buffer->text.size());
+    }
+
+    return result;
+}
+
+#ifdef W5N_ROPE_COUNTERS
+template <RopeUnit Unit>
+auto BasicRope<Unit>::counters() -> Counters
+{
+    auto value = [](Event event) -> size_t {
+        return events[static_cast<size_t>(event)];
+    };
+
+    return {value(Event::NodeAllocation),
+            value(Event::BufferAllocation),
+            value(Event::Split),
+            value(Event::Concat),
+            value(Event::Rebalance),
+            value(Event::Compaction),
+            value(Event::Segmentation)};
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::resetCounters()
+{
+    for (auto& event : events) {
+        event = 0;
+    }
+}
+#endif
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::append(std::string_view content)
+{
+    if (!absorbAtEdge(content, true)) {
+        root = concat(root, makeTree(content, resource), resource);
+    }
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::prepend(std::string_view content)
+{
+    if (!absorbAtEdge(content, false)) {
+        root = concat(makeTree(content, resource), root, resource);
+    }
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::clear()
+{
+    root = makeNode({}, resource);
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::compact()
+{
+    root = joinUnderfullLeaves(compact(root, resource), resource);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::insert(size_t position, std::string_view content)
+{
+    return insert(position, content, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::erase(size_t position, size_t size)
+{
+    return erase(position, size, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::insertAtByte(size_t offset, std::string_view content)
+{
+    return insert(offset, content, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::eraseBytes(size_t offset, size_t size)
+{
+    return erase(offset, size, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::append(const BasicRope& other)
+{
+    root = concat(root, other.root, resource);
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::prepend(const BasicRope& other)
+{
+    root = concat(other.root, root, resource);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::insert(size_t position, const BasicRope& other)
+{
+    return insert(position, other, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::insertAtByte(size_t offset, const BasicRope& other)
+{
+    return insert(offset, other, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+std::optional<BasicRope<Unit>> BasicRope<Unit>::extract(size_t position, size_t size)
+{
+    return extract(position, size, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+std::optional<BasicRope<Unit>> BasicRope<Unit>::extractBytes(size_t offset, size_t size)
+{
+    return extract(offset, size, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::move(size_t from, size_t size, size_t to)
+{
+    return move(from, size, to, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::moveBytes(size_t from, size_t size, size_t to)
+{
+    return move(from, size, to, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::insertAtChar(size_t index, std::string_view content)
+    requires Unit::counted
+{
+    return insert(index, content, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::eraseChars(size_t index, size_t count)
+    requires Unit::counted
+{
+    return erase(index, count, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::applyEdits(std::span<const Edit> edits)
+{
+    size_t end = 0;
+
+    for (const auto& edit : edits) {
+        if (edit.offset < end || edit.offset > root->size || edit.size > root->size - edit.offset) {
+            return false;
+        }
+
+        end = edit.offset + edit.size;
+    }
+
+    if (edits.empty()) {
+        return true;
+    }
+
+    // Walks the tree once, in order, only going down into the nodes an edit falls into and keeping the others whole.
+    // A node walked through is replaced by nodes of the same height, so the new children of a node are grouped into
+    // parents as soon as it is done and the tree is built bottom-up along the way. Boundaries are checked in the leaves
+    // an edit starts or ends in.
+    struct EditWalker
+    {
+        std::span<const Edit> edits;
+        std::pmr::memory_resource* resource;
+        size_t next;
+        bool inserted;
+        bool valid;
+
+        // whether the first edit not fully applied yet starts before end, or at the end of the rope
+        bool reaches(size_t end, bool last) const
+        {
+            return next < edits.size() && (edits[next].offset < end || (last && edits[next].offset == end));
+        }
+
+        std::vector<NodePtr> rebuild(const RopeNode* node, size_t start, bool last)
+        {
+            if (node->isLeaf()) {
+                return rebuildLeaf(node, start, last);
+            }
+
+            std::vector<NodePtr> nodes;
+
+            for (size_t i = 0; i < node->childCount && valid; ++i) {
+                const auto& child = node->children[i];
+                const size_t end = start + child->size;
+                const bool child_last = last && i + 1 == node->childCount;
+
+                if (!reaches(end, child_last)) {
+                    nodes.push_back(child);
+                } else if (inserted && edits[next].offset + edits[next].size >= end) {
+                    // erased as a whole by an edit whose text is already in
+                    if (edits[next].offset + edits[next].size == end) {
+                        ++next;
+                        inserted = false;
+                    }
+                } else {
+                    auto parts = rebuild(child.get(), start, child_last);
+                    nodes.insert(nodes.end(), parts.begin(), parts.end());
+                }
+
+                start = end;
+            }
+
+            if (!valid) {
+                return {};
+            }
+
+            return makeParents(balance(std::move(nodes)), resource);
+        }
+
+        std::vector<NodePtr> rebuildLeaf(const RopeNode* leaf, size_t start, bool last)
+        {
+            std::vector<NodePtr> leaves;
+            const size_t end = start + leaf->size;
+            size_t kept = start;
+
+            auto keep = [&](size_t until) {
+                if (until > kept) {
+                    leaves.push_back(
+                        allocateNode(resource, leaf->buffer, leaf->offset + kept - start, until - kept, resource));
+                }
+            };
+
+            while (reaches(end, last)) {
+                const auto& edit = edits[next];
+
+                if (!inserted) {
+                    if (!leaf->isCharBoundary(edit.offset - start)) {
+                        valid = false;
+                        return {};
+                    }
+
+                    keep(edit.offset);
+                    auto text = makeLeaves(edit.text, resource);
+                    leaves.insert(leaves.end(), text.begin(), text.end());
+                    inserted = true;
+                }
+
+                // the rest of the leaf is erased, and the edit goes on in the next ones
+                const size_t edit_end = edit.offset + edit.size;
+
+                if (edit_end > end) {
+                    return leaves;
+                }
+
+                if (!leaf->isCharBoundary(edit_end - start)) {
+                    valid = false;
+                    return {};
+                }
+
+                kept = edit_end;
+                ++next;
+                inserted = false;
+            }
+
+            keep(end);
+
+            return leaves;
+        }
+
+        // Nodes of the same height, in order. One left underfull by an edit is merged with a neighbour, which gives
+        // one node, or two that are not underfull anymore.
+        std::vector<NodePtr> balance(std::vector<NodePtr> nodes)
+        {
+            for (size_t i = 0; i < nodes.size() && nodes.size() > 1;) {
+                if (!nodes[i]->isUnderfull()) {
+                    ++i;
+                    continue;
+                }
+
+                const size_t first = i + 1 < nodes.size() ? i : i - 1;
+                const auto& left = nodes[first];
+                const auto& right = nodes[first + 1];
+                std::vector<NodePtr> merged;
+
+                if (left->isLeaf()) {
+                    std::string content;
+                    content.reserve(left->size + right->size);
+                    content.append(left->text());
+                    content.append(right->text());
+                    merged = makeLeaves(content, resource);
+                } else {
+                    std::vector<NodePtr> children{left->childNodes().begin(), left->childNodes().end()};
+                    children.insert(children.end(), right->childNodes().begin(), right->childNodes().end());
+                    merged = makeParents(children, resource);
+                }
+
+                countEvent(Event::Rebalance);
+                auto position = nodes.begin() + static_cast<std::ptrdiff_t>(first);
+                position = nodes.erase(position, position + 2);
+                nodes.insert(position, merged.begin(), merged.end());
+                i = first;
+            }
+
+            return nodes;
+        }
+    };
+
+    EditWalker walker{edits, resource, 0, false, true};
+    auto nodes = walker.balance(walker.rebuild(root.get(), 0, true));
+
+    if (!walker.valid) {
+        return false;
+    }
+
+    // parents left with a single child at the top of the tree are dropped
+    auto result = doMerge(std::move(nodes), resource);
+
+    while (!result->isLeaf() && result->childCount == 1) {
+        result = result->children[0];
+    }
+
+    // an edit erasing a whole last child up to the end of the rope ends the walk there, and the insertions at the end
+    // that follow it are left
+    std::string tail;
+
+    for (const auto& edit : edits.subspan(walker.next)) {
+        tail.append(edit.text);
+    }
+
+    root = tail.empty() ? result : concat(result, makeTree(tail, resource), resource);
+
+    return true;
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::toString() const
+{
+    return root->toString();
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::forEachChunk(const std::function<void(std::string_view)>& visitor) const
+{
+    Cursor cursor{root};
+
+    do {
+        if (cursor.leaf()->size > 0) {
+            visitor(cursor.leaf()->text());
+        }
+    } while (cursor.nextLeaf());
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::writeTo(std::ostream& stream) const
+{
+    forEachChunk([&stream](std::string_view chunk) {
+        stream.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    });
+}
+
+#ifndef _WIN32
+template <RopeUnit Unit>
+bool BasicRope<Unit>::writeTo(int fd) const
+{
+#ifdef IOV_MAX
+    constexpr size_t MAX_CHUNKS = IOV_MAX;
+#else
+    constexpr size_t MAX_CHUNKS = 1024;
+#endif
+
+    auto write_chunks = [fd](std::span<iovec> chunks) {
+        while (!chunks.empty()) {
+            const auto written = ::writev(fd, chunks.data(), static_cast<int>(chunks.size()));
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            // writev may stop anywhere, even in the middle of a chunk
+            auto remaining = static_cast<size_t>(written);
+
+            while (!chunks.empty() && remaining >= chunks.front().iov_len) {
+                remaining -= chunks.front().iov_len;
+                chunks = chunks.subspan(1);
+            }
+
+            if (remaining > 0) {
+                chunks.front().iov_base = static_cast<char*>(chunks.front().iov_base) + remaining;
+                chunks.front().iov_len -= remaining;
+            }
+        }
+
+        return true;
+    };
+
+    std::vector<iovec> chunks;
+    Cursor cursor{root};
+
+    do {
+        auto text = cursor.leaf()->text();
+
+        if (text.empty()) {
+            continue;
+        }
+
+        chunks.push_back({const_cast<char*>(text.data()), text.size()});
+
+        if (chunks.size() == MAX_CHUNKS) {
+            if (!write_chunks(chunks)) {
+                return false;
+            }
+
+            chunks.clear();
+        }
+    } while (cursor.nextLeaf());
+
+    return write_chunks(chunks);
+}
+#endif
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::serialize(std::ostream& stream) const
+{
+    std::string header{SERIALIZATION_MAGIC};
+    header += static_cast<char>(SERIALIZATION_VERSION);
+    header += static_cast<char>(serializedCounts<Unit>());
+    writeVarint(header, root->size);
+    stream.write(header.data(), static_cast<std::streamsize>(header.size()));
+    writeTo(stream);
+
+    // leaves whose counts have not been computed yet are stored without them, they are computed after reloading
+    std::string tree;
+    std::vector<const RopeNode*> pending{root.get()};
+
+    while (!pending.empty()) {
+        const auto* node = pending.back();
+        pending.pop_back();
+        writeVarint(tree, node->childCount);
+
+        if (!node->isLeaf()) {
+            auto children = node->childNodes();
+
+            for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                pending.push_back(it->get());
+            }
+
+            continue;
+        }
+
+        // line breaks cost next to nothing to count while the text is written anyway, characters are only stored when
+        // something already asked for them
+        node->computeLineBreaks();
+        const bool metrics = node->hasMetrics();
+        writeVarint(tree, node->size);
+        writeVarint(tree, metrics ? 1 : 0);
+
+        if (!metrics) {
+            continue;
+        }
+
+        writeVarint(tree, node->lineBreaks);
+
+        if constexpr (Unit::counted) {
+            writeVarint(tree, node->chars.count);
+            writeVarint(tree, node->chars.checkpoints.size());
+            typename RopeNode::Checkpoint previous{0, 0};
+
+            for (const auto& checkpoint : node->chars.checkpoints) {
+                writeVarint(tree, checkpoint.index - previous.index);
+                writeVarint(tree, checkpoint.offset - previous.offset);
+                previous = checkpoint;
+            }
+        }
+    }
+
+    std::string tree_size;
+    writeVarint(tree_size, tree.size());
+    stream.write(tree_size.data(), static_cast<std::streamsize>(tree_size.size()));
+    stream.write(tree.data(), static_cast<std::streamsize>(tree.size()));
+
+    return stream.good();
+}
+
+template <RopeUnit Unit>
+std::optional<BasicRope<Unit>> BasicRope<Unit>::deserialize(std::istream& stream, std::pmr::memory_resource* resource)
+{
+    std::array<char, SERIALIZATION_MAGIC.size() + 2> header;
+
+    if (!stream.read(header.data(), header.size()) ||
+        std::string_view{header.data(), SERIALIZATION_MAGIC.size()} != SERIALIZATION_MAGIC ||
+        static_cast<uint8_t>(header[SERIALIZATION_MAGIC.size()]) != SERIALIZATION_VERSION) {
+        return std::nullopt;
+    }
+
+    // counts of another unit than the one of this rope are read past, and the leaves measured again
+    const auto counts = static_cast<uint8_t>(header.back() & (SERIALIZED_GRAPHEMES | SERIALIZED_CODE_POINTS));
+    const auto text_size = readVarint(stream);
+    std::pmr::string content{resource};
+
+    if (!text_size || !readBytes(stream, *text_size, content)) {
+        return std::nullopt;
+    }
+
+    const auto tree_size = readVarint(stream);
+    std::string tree;
+
+    if (!tree_size || !readBytes(stream, *tree_size, tree)) {
+        return std::nullopt;
+    }
+
+    // every leaf is a slice of the text, which is read into a single buffer
+    BufferPtr buffer;
+
+    if (!content.empty()) {
+        buffer = allocateBuffer(resource, std::move(content));
+    }
+
+    struct TreeReader
+    {
+        std::string_view data;
+        const BufferPtr& buffer;
+        size_t offset;
+        uint8_t counts;
+        std::pmr::memory_resource* resource;
+
+        std::optional<uint64_t> next()
+        {
+            uint64_t value = 0;
+
+            for (unsigned shift = 0; shift < 64 && !data.empty(); shift += 7) {
+                const auto byte = static_cast<uint8_t>(data.front());
+                data.remove_prefix(1);
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+                if ((byte & 0x80) == 0) {
+                    return value;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        NodePtr readNode(size_t depth)
+        {
+            const auto child_count = next();
+
+            if (!child_count || *child_count > RopeNode::MAX_CHILDREN || depth > MAX_SERIALIZED_DEPTH) {
+                return nullptr;
+            }
+
+            if (*child_count == 0) {
+                return readLeaf(depth == 0);
+            }
+
+            // every leaf has to be at the same depth, like in the tree that was serialized
+            std::array<NodePtr, RopeNode::MAX_CHILDREN> children;
+
+            for (size_t i = 0; i < *child_count; ++i) {
+                children[i] = readNode(depth + 1);
+
+                if (!children[i] || children[i]->height != children[0]->height) {
+                    return nullptr;
+                }
+            }
+
+            return allocateNode(resource, std::span<const NodePtr>{children}.first(*child_count));
+        }
+
+        // Graphemes and code points both start on a code point, and the checks that are cheap for the unit of this
+        // rope are made when the counts are of the same unit.
+        bool isCharStart(size_t leaf_offset, size_t size, size_t byte) const
+        {
+            const auto text = buffer->text.substr(leaf_offset, size);
+
+            if (Segmenter<metrics::CodePoints>::isContinuation(text[byte])) {
+                return false;
+            }
+
+            if constexpr (Unit::counted) {
+                if (byte > 0 && counts == serializedCounts<Unit>()) {
+                    return Segmenter<Unit>::isBoundary(text, byte).value_or(true);
+                }
+            }
+
+            return true;
+        }
+
+        NodePtr readLeaf(bool root)
+        {
+            const size_t text_size = buffer == nullptr ? 0 : buffer->text.size();
+            const auto size = next();
+            const auto metrics = next();
+
+            // Only the root of an empty rope is an empty leaf, and only a rope counting graphemes has leaves over
+            // MAX_LEAF_SIZE, when a grapheme longer than the window leafBoundaries looks at left no place to cut.
+            // Leaves under MIN_LEAF_SIZE are valid, small ropes and the edges of edits have them.
+            if (!size || !metrics || *size > text_size - offset || (*size == 0 && !root) ||
+                (*size > RopeNode::MAX_LEAF_SIZE && (counts != SERIALIZED_GRAPHEMES || *size > UINT32_MAX))) {
+                return nullptr;
+            }
+
+            std::optional<uint64_t> line_breaks;
+            std::optional<uint64_t> char_count;
+            std::vector<typename RopeNode::Checkpoint> checkpoints;
+
+            if (*metrics != 0) {
+                line_breaks = next();
+
+                if (!line_breaks) {
+                    return nullptr;
+                }
+            }
+
+            if (*metrics != 0 && counts != 0) {
+                // A character takes at least a byte. The first checkpoint is at the start of the leaf, and no
+                // character is more than CHECKPOINT_STEP after one: they are every CHECKPOINT_STEP characters apart,
+                // except around where splitLeaf cut the leaf they come from.
+                constexpr uint64_t step = RopeNode::CHECKPOINT_STEP;
+                char_count = next();
+                const auto count = next();
+
+                if (!char_count || !count || *char_count > *size || (*char_count == 0) != (*size == 0) ||
+                    (*count == 0) != (*char_count == 0) || *count > *char_count) {
+                    return nullptr;
+                }
+
+                uint64_t index = 0;
+                uint64_t byte = 0;
+
+                for (uint64_t i = 0; i < *count; ++i) {
+                    const auto index_step = next();
+                    const auto byte_step = next();
+
+                    if (!index_step || !byte_step || (*index_step == 0) != (i == 0) || *index_step > step ||
+                        (*byte_step == 0) != (i == 0) || *byte_step < *index_step) {
+                        return nullptr;
+                    }
+
+                    index += *index_step;
+                    byte += *byte_step;
+
+                    if (index >= *char_count || byte >= *size || !isCharStart(offset, *size, byte)) {
+                        return nullptr;
+                    }
+
+                    checkpoints.push_back({static_cast<uint32_t>(index), static_cast<uint32_t>(byte)});
+                }
+
+                if (*char_count - index > step) {
+                    return nullptr;
+                }
+
+                if constexpr (Unit::counted) {
+                    if (counts == serializedCounts<Unit>() && !checkpoints.empty()) {
+                        // the characters after the last checkpoint are segmented again, which is cheap and catches a
+                        // count that does not go with the text
+                        const auto& last = checkpoints.back();
+                        const auto text = buffer->text.substr(offset + last.offset, *size - last.offset);
+                        size_t tail = 0;
+
+                        Segmenter<Unit>::forEachStart(text, [&tail](size_t) {
+                            ++tail;
+                            return true;
+                        });
+
+                        if (last.index + tail != *char_count) {
+                            return nullptr;
+                        }
+                    }
+                }
+            }
+
+            if (*size == 0) {
+                return allocateNode(resource);
+            }
+
+            const auto leaf_offset = offset;
+            offset += *size;
+
+            if constexpr (Unit::counted) {
+                if (char_count && counts == serializedCounts<Unit>()) {
+                    // line breaks are counted again by the constructor, which makes a cheap consistency check
+                    auto leaf = allocateNode(resource, buffer, leaf_offset, *size, *char_count, checkpoints, resource);
+
+                    return leaf->lineBreaks == *line_breaks ? leaf : nullptr;
+                }
+
+                return allocateNode(resource, buffer, leaf_offset, *size, resource);
+            } else {
+                auto leaf = allocateNode(resource, buffer, leaf_offset, *size, resource);
+
+                // counted again like in the constructor of counted leaves
+                if (line_breaks) {
+                    if (countLineBreaks(leaf->text()) != *line_breaks) {
+                        return nullptr;
+                    }
+
+                    leaf->lineBreaks = *line_breaks;
+                    leaf->linesState = MetricsState::Ready;
+                }
+
+                return leaf;
+            }
+        }
+    };
+
+    TreeReader reader{tree, buffer, 0, counts, resource};
+    auto root = reader.readNode(0);
+
+    if (!root || !reader.data.empty() || reader.offset != *text_size) {
+        return std::nullopt;
+    }
+
+    return BasicRope{std::move(root), resource};
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::substring(size_t from) const
+{
+    return substring(from, std::string::npos, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::substring(size_t from, size_t size) const
+{
+    return substring(from, size, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::substringBytes(size_t offset) const
+{
+    return substring(offset, std::string::npos, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::substringBytes(size_t offset, size_t size) const
+{
+    return substring(offset, size, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::substringChars(size_t index) const
+    requires Unit::counted
+{
+    return substring(index, std::string::npos, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::substringChars(size_t index, size_t count) const
+    requires Unit::counted
+{
+    return substring(index, count, Metric::Chars);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::copyTo(std::span<char> out, size_t offset, size_t size) const
+{
+    offset = std::min(offset, root->size);
+    size = std::min({size, out.size(), root->size - offset});
+    root->copyBytes(offset, size, out.data());
+
+    return size;
+}
+
+template <RopeUnit Unit>
+std::optional<std::string_view> BasicRope<Unit>::view(size_t offset, size_t size) const
+{
+    offset = std::min(offset, root->size);
+    size = std::min(size, root->size - offset);
+
+    if (size == 0) {
+        return std::string_view{};
+    }
+
+    return root->view(offset, size);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::find(std::string_view needle, size_t offset) const
+{
+    if (needle.empty()) {
+        return offset <= root->size ? offset : std::string::npos;
+    }
+
+    size_t found = std::string::npos;
+    forEachMatch(needle, offset, root->size, [&found](size_t match) {
+        found = match;
+        return false;
+    });
+
+    return found;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::rfind(std::string_view needle, size_t offset) const
+{
+    if (needle.size() > root->size) {
+        return std::string::npos;
+    }
+
+    offset = std::min(offset, root->size - needle.size());
+
+    if (needle.empty()) {
+        return offset;
+    }
+
+    const size_t overlap = needle.size() - 1;
+    Cursor cursor{root};
+    size_t end = cursor.seek(offset + needle.size(), Metric::Bytes);
+
+    // first bytes of the following leaves, for the matches starting in the current leaf and ending after it
+    std::string head;
+
+    do {
+        auto text = cursor.leaf()->text().substr(0, end);
+        const size_t leaf_start = cursor.leafStart(Metric::Bytes);
+
+        if (!head.empty()) {
+            const size_t tail_start = text.size() - std::min(overlap, text.size());
+            auto window = std::string{text.substr(tail_start)} + head;
+            auto match = window.rfind(needle);
+
+            if (match != std::string::npos) {
+                return leaf_start + tail_start + match;
+            }
+        }
+
+        auto match = text.rfind(needle);
+
+        if (match != std::string::npos) {
+            return leaf_start + match;
+        }
+
+        if (text.size() >= overlap) {
+            head = text.substr(0, overlap);
+        } else {
+            head = std::string{text} + head.substr(0, overlap - text.size());
+        }
+
+        end = std::string::npos;
+    } while (cursor.previousLeaf());
+
+    return std::string::npos;
+}
+
+template <RopeUnit Unit>
+std::vector<size_t> BasicRope<Unit>::findAll(std::string_view needle) const
+{
+    std::vector<size_t> matches;
+
+    if (!needle.empty()) {
+        forEachMatch(needle, 0, root->size, [&matches](size_t match) {
+            matches.push_back(match);
+            return true;
+        });
+    }
+
+    return matches;
+}
+
+#ifndef W5N_ROPE_SINGLE_THREADED
+template <RopeUnit Unit>
+auto BasicRope<Unit>::threadExecutor(size_t threads) -> Executor
+{
+    return [threads](size_t count, const std::function<void(size_t)>& task) {
+        std::atomic<size_t> next{0};
+        std::vector<std::exception_ptr> errors(std::max<size_t>(std::min(threads, count), 1));
+
+        auto work = [&next, &errors, &task, count](size_t worker) {
+            try {
+                for (auto i = next++; i < count; i = next++) {
+                    task(i);
+                }
+            } catch (...) {
+                errors[worker] = std::current_exception();
+                next = count;
+            }
+        };
+
+        // the calling thread is one of the workers
+        std::vector<std::thread> workers;
+        workers.reserve(errors.size() - 1);
+
+        for (size_t worker = 1; worker < errors.size(); ++worker) {
+            workers.emplace_back(work, worker);
+        }
+
+        work(0);
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    };
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::toString(const Executor& executor) const
+{
+    // every task copies its subtree straight to where it goes in the result
+    std::string result(root->size, '\0');
+    const auto parts = subtrees(PARALLEL_GRAIN);
+
+    executor(parts.size(), [&result, &parts](size_t i) {
+        auto [node, offset] = parts[i];
+        node->copyBytes(0, node->size, result.data() + offset);
+    });
+
+    return result;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::find(std::string_view needle, const Executor& executor) const
+{
+    if (needle.empty()) {
+        return 0;
+    }
+
+    // each task looks for the first match starting in its subtree, the earliest one wins
+    const auto parts = subtrees(PARALLEL_GRAIN);
+    std::vector<size_t> found(parts.size(), std::string::npos);
+
+    executor(parts.size(), [this, needle, &parts, &found](size_t i) {
+        auto [node, offset] = parts[i];
+
+        forEachMatch(needle, offset, offset + node->size, [&found, i](size_t match) {
+            found[i] = match;
+            return false;
+        });
+    });
+
+    return *std::min_element(found.begin(), found.end());
+}
+
+template <RopeUnit Unit>
+std::vector<size_t> BasicRope<Unit>::findAll(std::string_view needle, const Executor& executor) const
+{
+    if (needle.empty()) {
+        return {};
+    }
+
+    const auto parts = subtrees(PARALLEL_GRAIN);
+    std::vector<std::vector<size_t>> found(parts.size());
+
+    auto search = [this, needle, &parts, &found](size_t i, size_t from) {
+        const size_t end = parts[i].second + parts[i].first->size;
+        found[i].clear();
+
+        forEachMatch(needle, from, end, [&found, i](size_t match) {
+            found[i].push_back(match);
+            return true;
+        });
+    };
+
+    executor(parts.size(), [&search, &parts](size_t i) {
+        search(i, parts[i].second);
+    });
+
+    // A match running into the next subtree may overlap the first matches found there. That subtree is searched
+    // again from the end of the match, which only happens when the needle repeats across the boundary.
+    std::vector<size_t> matches;
+    size_t resume = 0;
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (!found[i].empty() && found[i].front() < resume) {
+            search(i, resume);
+        }
+
+        matches.insert(matches.end(), found[i].begin(), found[i].end());
+
+        if (!found[i].empty()) {
+            resume = found[i].back() + needle.size();
+        }
+    }
+
+    return matches;
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::computeMetrics(const Executor& executor) const
+{
+    const auto parts = subtrees(PARALLEL_GRAIN);
+
+    executor(parts.size(), [&parts](size_t i) {
+        parts[i].first->computeMetrics();
+    });
+
+    // the nodes above the subtrees only have to add up their children now
+    root->computeMetrics();
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit> BasicRope<Unit>::fromString(std::string_view content,
+                                             const Executor& executor,
+                                             std::pmr::memory_resource* resource)
+{
+    const std::array<std::string_view, 1> chunks{content};
+
+    return fromChunks(chunks, executor, resource);
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit> BasicRope<Unit>::fromChunks(std::span<const std::string_view> chunks,
+                                            const Executor& executor,
+                                            std::pmr::memory_resource* resource)
+{
+    auto buffer = joinChunks(chunks, resource);
+
+    if (buffer == nullptr) {
+        return BasicRope{resource};
+    }
+
+    // segmenting the leaves is what costs, copying the text and placing the cuts is cheap next to it
+    auto leaves = sliceLeaves(buffer, leafBoundaries(buffer->text), resource);
+    const size_t leaves_per_task = std::max<size_t>(PARALLEL_GRAIN / RopeNode::MAX_LEAF_SIZE, 1);
+
+    executor((leaves.size() + leaves_per_task - 1) / leaves_per_task, [&leaves, leaves_per_task](size_t i) {
+        const size_t last = std::min(leaves.size(), (i + 1) * leaves_per_task);
+
+        for (size_t leaf = i * leaves_per_task; leaf < last; ++leaf) {
+            leaves[leaf]->computeMetrics();
+        }
+    });
+
+    auto root = doMerge(std::move(leaves), resource);
+    root->computeMetrics();
+
+    return BasicRope{root, resource};
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::subtrees(size_t grain) const -> std::vector<std::pair<const RopeNode*, size_t>>
+{
+    std::vector<std::pair<const RopeNode*, size_t>> parts;
+    std::vector<std::pair<const RopeNode*, size_t>> pending{{root.get(), 0}};
+
+    while (!pending.empty()) {
+        auto [node, offset] = pending.back();
+        pending.pop_back();
+
+        if (node->size <= grain || node->isLeaf()) {
+            parts.emplace_back(node, offset);
+            continue;
+        }
+
+        // pushed in reverse so the subtrees come out in order
+        offset += node->size;
+
+        for (size_t i = node->childCount; i-- > 0;) {
+            offset -= node->children[i]->size;
+            pending.emplace_back(node->children[i].get(), offset);
+        }
+    }
+
+    return parts;
+}
+#endif
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::lineCount() const
+{
+    return root->measure(Metric::Lines) + 1;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::lineStart(size_t line) const
+{
+    if (line == 0) {
+        return 0;
+    }
+
+    if (line > root->measure(Metric::Lines)) {
+        return std::string::npos;
+    }
+
+    return root->lineBreakOffset(line - 1) + 1;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::offsetToLineCol(size_t offset) const -> LineColumn
+{
+    offset = std::min(offset, root->size);
+    const size_t line = root->lineBreaksBefore(offset);
+
+    return {line, offset - lineStart(line)};
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::lineColToOffset(size_t line, size_t column) const
+{
+    const size_t start = lineStart(line);
+
+    if (start == std::string::npos) {
+        return start;
+    }
+
+    const size_t end = line < root->measure(Metric::Lines) ? root->lineBreakOffset(line) : root->size;
+
+    return start + std::min(column, end - start);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::size() const
+{
+    return root->size;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::charCount() const
+    requires Unit::counted
+{
+    return root->measure(Metric::Chars);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::charIndex(size_t offset) const
+    requires Unit::counted
+{
+    if (offset > root->size) {
+        return std::string::npos;
+    }
+
+    Cursor cursor{root};
+    const size_t position = cursor.seek(offset, Metric::Bytes);
+    auto index = cursor.leaf()->charsBefore(position);
+
+    return index == std::string::npos ? index : cursor.leafStart(Metric::Chars) + index;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::at(size_t index) const -> CharType
+{
+    return root->at(index);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::begin() const -> iterator
+{
+    return iterator{root, 0};
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::end() const -> iterator
+{
+    return iterator{root, root->measure(Metric::Chars)};
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::bytes() const -> std::ranges::subrange<ByteIterator>
+{
+    return {ByteIterator{root, 0}, ByteIterator{root, root->size}};
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::graphemes() const -> std::ranges::subrange<CharIterator>
+    requires std::same_as<Unit, metrics::Graphemes>
+{
+    return {CharIterator{root, 0}, CharIterator{root, root->measure(Metric::Chars)}};
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::BasicRope(NodePtr r, std::pmr::memory_resource* resource) : root(r), resource(resource)
+{
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::split(size_t index, Metric metric) const -> std::pair<NodePtr, NodePtr>
+{
+    return root->split(index, metric, resource);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::measure(Metric metric) const
+{
+    return root->measure(metric);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::insert(size_t position, std::string_view content, Metric metric)
+{
+    if (position > measure(metric)) {
+        return false;
+    }
+
+    if (metric == Metric::Bytes && !root->isCharBoundary(position)) {
+        return false;
+    }
+
+    auto parts = split(position, metric);
+
+    root = concat(concat(parts.first, makeTree(content, resource), resource), parts.second, resource);
+
+    return true;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::erase(size_t position, size_t size, Metric metric)
+{
+    return size != 0 && extract(position, size, metric).has_value();
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::insert(size_t position, const BasicRope& other, Metric metric)
+{
+    if (position > measure(metric)) {
+        return false;
+    }
+
+    if (metric == Metric::Bytes && !root->isCharBoundary(position)) {
+        return false;
+    }
+
+    auto parts = split(position, metric);
+
+    root = concat(concat(parts.first, other.root, resource), parts.second, resource);
+
+    return true;
+}
+
+template <RopeUnit Unit>
+std::optional<BasicRope<Unit>> BasicRope<Unit>::extract(size_t position, size_t size, Metric metric)
+{
+    const auto total = measure(metric);
+    position = std::min(position, total);
+    size = std::min(size, total - position);
+
+    if (metric == Metric::Bytes && (!root->isCharBoundary(position) || !root->isCharBoundary(position + size))) {
+        return std::nullopt;
+    }
+
+    auto parts = split(position, metric);
+    auto removed_parts = parts.second->split(size, metric, resource);
+
+    root = concat(parts.first, removed_parts.second, resource);
+
+    return BasicRope{removed_parts.first, resource};
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::move(size_t from, size_t size, size_t to, Metric metric)
+{
+    const auto total = measure(metric);
+
+    if (from > total || to > total) {
+        return false;
+    }
+
+    size = std::min(size, total - from);
+
+    if (to > from && to < from + size) {
+        return false;
+    }
+
+    if (metric == Metric::Bytes && !root->isCharBoundary(to)) {
+        return false;
+    }
+
+    auto block = extract(from, size, metric);
+
+    if (!block) {
+        return false;
+    }
+
+    return insert(to >= from + size ? to - size : to, *block, metric);
+}
+
+template <RopeUnit Unit>
+std::string BasicRope<Unit>::substring(size_t from, size_t size, Metric metric) const
+{
+    if (metric == Metric::Chars) {
+        // the graphemes are turned into a byte range, so nothing has to be split
+        const auto total = measure(metric);
+        from = std::min(from, total);
+        size = std::min(size, total - from);
+
+        const size_t begin = root->byteOffset(from);
+        size = root->byteOffset(from + size) - begin;
+        from = begin;
+    }
+
+    // bytes are copied straight from the leaves, without building any node
+    from = std::min(from, root->size);
+    size = std::min(size, root->size - from);
+
+    std::string result(size, '\0');
+    root->copyBytes(from, size, result.data());
+
+    return result;
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::Cursor::Cursor() : current(nullptr), start(0)
+{
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::Cursor::Cursor(NodePtr root) : root(std::move(root)), current(nullptr), start(0)
+{
+    descend(this->root.get(), true);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::Cursor::seek(size_t position, Metric metric)
+{
+    path.clear();
+    start = 0;
+    const RopeNode* node = root.get();
+
+    while (!node->isLeaf()) {
+        auto children = node->childNodes();
+        size_t child = 0;
+
+        while (child + 1 < children.size() && position >= children[child]->measure(metric)) {
+            position -= children[child]->measure(metric);
+            start += children[child]->size;
+            ++child;
+        }
+
+        path.push_back({node, child});
+        node = children[child].get();
+    }
+
+    current = node;
+
+    return std::min(position, current->measure(metric));
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::Cursor::nextLeaf()
+{
+    auto frame = std::find_if(
+        path.rbegin(), path.rend(), [](const auto& frame) { return frame.child + 1 < frame.node->childCount; });
+
+    if (frame == path.rend()) {
+        return false;
+    }
+
+    start += current->size;
+    path.erase(frame.base(), path.end());
+    ++path.back().child;
+    descend(path.back().node->children[path.back().child].get(), true);
+
+    return true;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::Cursor::previousLeaf()
+{
+    auto frame = std::find_if(path.rbegin(), path.rend(), [](const auto& frame) { return frame.child > 0; });
+
+    if (frame == path.rend()) {
+        return false;
+    }
+
+    path.erase(frame.base(), path.end());
+    --path.back().child;
+    descend(path.back().node->children[path.back().child].get(), false);
+    start -= current->size;
+
+    return true;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::Cursor::leaf() const -> const RopeNode*
+{
+    return current;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::Cursor::leafStart(Metric metric) const
+{
+    if (metric == Metric::Bytes) {
+        return start;
+    }
+
+    size_t result = 0;
+
+    for (const auto& frame : path) {
+        for (size_t i = 0; i < frame.child; ++i) {
+            result += frame.node->children[i]->measure(metric);
+        }
+    }
+
+    return result;
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::Cursor::descend(const RopeNode* node, bool leftmost)
+{
+    while (!node->isLeaf()) {
+        const size_t child = leftmost ? 0 : node->childCount - 1;
+        path.push_back({node, child});
+        node = node->children[child].get();
+    }
+
+    current = node;
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::ByteIterator::ByteIterator() : position(0)
+{
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::ByteIterator::ByteIterator(NodePtr root, size_t offset) : cursor(std::move(root))
+{
+    position = cursor.seek(offset, Metric::Bytes);
+}
+
+template <RopeUnit Unit>
+char BasicRope<Unit>::ByteIterator::operator*() const
+{
+    return cursor.leaf()->text()[position];
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::ByteIterator::operator++() -> ByteIterator&
+{
+    ++position;
+
+    while (position >= cursor.leaf()->size && cursor.nextLeaf()) {
+        position = 0;
+    }
+
+    return *this;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::ByteIterator::operator++(int) -> ByteIterator
+{
+    auto copy = *this;
+    ++*this;
+    return copy;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::ByteIterator::operator--() -> ByteIterator&
+{
+    while (position == 0 && cursor.previousLeaf()) {
+        position = cursor.leaf()->size;
+    }
+
+    --position;
+
+    return *this;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::ByteIterator::operator--(int) -> ByteIterator
+{
+    auto copy = *this;
+    --*this;
+    return copy;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::ByteIterator::operator==(const ByteIterator& other) const
+{
+    return offset() == other.offset();
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::ByteIterator::offset() const
+{
+    return cursor.leafStart(Metric::Bytes) + position;
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::CharIterator::CharIterator() : leafIndex(0), position(0), first(0), last(0)
+{
+}
+
+template <RopeUnit Unit>
+BasicRope<Unit>::CharIterator::CharIterator(NodePtr root, size_t index) : cursor(std::move(root))
+{
+    position = cursor.seek(index, Metric::Chars);
+    leafIndex = cursor.leafStart(Metric::Chars);
+    loadBounds();
+}
+
+template <RopeUnit Unit>
+std::string_view BasicRope<Unit>::CharIterator::operator*() const
+{
+    return cursor.leaf()->text().substr(first, last - first);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::CharIterator::operator++() -> CharIterator&
+{
+    ++position;
+
+    if (position < cursor.leaf()->measure(Metric::Chars)) {
+        // the next character starts where this one ends, no need to look at the leaf's checkpoints
+        first = last;
+
+        if constexpr (Unit::counted) {
+            last += Segmenter<Unit>::charSize(cursor.leaf()->text().substr(last));
+        } else {
+            ++last;
+        }
+    } else {
+        while (position == cursor.leaf()->measure(Metric::Chars)) {
+            const size_t leaf_chars = position;
+
+            if (!cursor.nextLeaf()) {
+                break;
+            }
+
+            leafIndex += leaf_chars;
+            position = 0;
+        }
+
+        loadBounds();
+    }
+
+    return *this;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::CharIterator::operator++(int) -> CharIterator
+{
+    auto copy = *this;
+    ++*this;
+    return copy;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::CharIterator::operator--() -> CharIterator&
+{
+    while (position == 0 && cursor.previousLeaf()) {
+        position = cursor.leaf()->measure(Metric::Chars);
+        leafIndex -= position;
+    }
+
+    --position;
+    loadBounds();
+
+    return *this;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::CharIterator::operator--(int) -> CharIterator
+{
+    auto copy = *this;
+    --*this;
+    return copy;
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::CharIterator::operator==(const CharIterator& other) const
+{
+    return index() == other.index();
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::CharIterator::index() const
+{
+    return leafIndex + position;
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::CharIterator::offset() const
+{
+    return cursor.leafStart(Metric::Bytes) + first;
+}
+
+template <RopeUnit Unit>
+void BasicRope<Unit>::CharIterator::loadBounds()
+{
+    if (position < cursor.leaf()->measure(Metric::Chars)) {
+        std::tie(first, last) = cursor.leaf()->charBounds(position);
+    } else {
+        first = last = cursor.leaf()->size;
+    }
+}
+
+template <RopeUnit Unit>
+template <typename Visitor>
+void BasicRope<Unit>::forEachMatch(std::string_view needle, size_t offset, size_t end, Visitor visitor) const
+{
+    if (offset > root->size || needle.size() > root->size - offset) {
+        return;
+    }
+
+    // leaves are searched in place (std::string_view::find skips to candidates with memchr), only the bytes around
+    // leaf boundaries are copied to find the matches spanning them
+    const size_t overlap = needle.size() - 1;
+    Cursor cursor{root};
+    cursor.seek(offset, Metric::Bytes);
+
+    // last bytes of the previous leaves, for the matches starting there and ending in the current leaf
+    std::string tail;
+    size_t tail_start = offset;
+    size_t resume = offset;
+    size_t leaf_end = 0;
+
+    do {
+        auto text = cursor.leaf()->text();
+        const size_t leaf_start = cursor.leafStart(Metric::Bytes);
+        leaf_end = leaf_start + text.size();
+
+        if (!tail.empty()) {
+            auto window = tail + std::string{text.substr(0, overlap)};
+            auto match = window.find(needle, std::max(resume, tail_start) - tail_start);
+
+            for (; match != std::string::npos; match = window.find(needle, match + needle.size())) {
+                if (tail_start + match >= end || !visitor(tail_start + match)) {
+                    return;
+                }
+
+                resume = tail_start + match + needle.size();
+            }
+        }
+
+        for (auto match = text.find(needle, std::max(resume, leaf_start) - leaf_start); match != std::string::npos;
+             match = text.find(needle, match + needle.size())) {
+            if (leaf_start + match >= end || !visitor(leaf_start + match)) {
+                return;
+            }
+
+            resume = leaf_start + match + needle.size();
+        }
+
+        const size_t next_tail_start = std::max(resume, leaf_end - std::min(overlap, leaf_end));
+
+        if (next_tail_start >= leaf_start) {
+            tail = text.substr(next_tail_start - leaf_start);
+        } else {
+            tail = tail.substr(next_tail_start - tail_start) + std::string{text};
+        }
+
+        tail_start = next_tail_start;
+    } while (leaf_end < end + overlap && cursor.nextLeaf());
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::absorbAtEdge(std::string_view content, bool at_end)
+{
+    if (content.empty()) {
+        return true;
+    }
+
+    // Nodes are only changed in place when this rope holds the only reference to them, so copies, iterators and
+    // other ropes sharing the subtree never see it.
+    auto* node = const_cast<RopeNode*>(root.get());
+    RopeNode* parent = nullptr;
+
+    while (node->refCount == 1 && !node->isLeaf()) {
+        parent = node;
+        node = const_cast<RopeNode*>(at_end ? node->children[node->childCount - 1].get() : node->children[0].get());
+    }
+
+    if (node->refCount != 1 || node->size + content.size() > RopeNode::MAX_LEAF_SIZE) {
+        return false;
+    }
+
+    const auto& buffer = node->buffer;
+    const bool exclusive = buffer != nullptr && buffer.useCount() == 1 && buffer->mapping == nullptr;
+    const bool fits = buffer != nullptr && (at_end ? node->offset + node->size + content.size() <= buffer->text.size()
+                                                   : node->offset >= content.size());
+
+    if (exclusive && fits) {
+        // the bytes outside of the slice are not referenced by any other leaf, they can be overwritten
+        auto& storage = const_cast<LeafBuffer&>(*buffer).storage;
+        const size_t position = at_end ? node->offset + node->size : node->offset - content.size();
+        std::copy(content.begin(), content.end(), storage.begin() + static_cast<std::ptrdiff_t>(position));
+
+        node->offset = at_end ? node->offset : position;
+        node->size += content.size();
+        node->charsState = MetricsState::Pending;
+        node->linesState = MetricsState::Pending;
+        buffer->liveBytes += content.size();
+    } else {
+        // Copy the leaf into a buffer with room to spare, the next small edits on this side are then written in
+        // place. The room doubles with each copy up to a whole leaf, so a small rope stays small. Appended text grows
+        // from the start of the buffer, prepended text from its end.
+        const size_t size = node->size + content.size();
+        const size_t capacity = std::min(RopeNode::MAX_LEAF_SIZE, std::max(2 * size, RopeNode::MIN_LEAF_SIZE));
+        auto spare = allocateBuffer(resource, capacity, resource);
+        const size_t position = at_end ? 0 : capacity - size;
+        auto out = const_cast<LeafBuffer&>(*spare).storage.begin() + static_cast<std::ptrdiff_t>(position);
+
+        if (at_end) {
+            std::copy(content.begin(), content.end(), std::copy(node->text().begin(), node->text().end(), out));
+        } else {
+            std::copy(node->text().begin(), node->text().end(), std::copy(content.begin(), content.end(), out));
+        }
+
+        auto leaf = allocateNode(resource, std::move(spare), position, size, resource);
+
+        if (parent == nullptr) {
+            root = std::move(leaf);
+        } else {
+            parent->children[at_end ? parent->childCount - 1 : 0] = std::move(leaf);
+        }
+    }
+
+    for (node = const_cast<RopeNode*>(root.get()); !node->isLeaf();) {
+        node->size += content.size();
+        node->charsState = MetricsState::Pending;
+        node->linesState = MetricsState::Pending;
+        node = const_cast<RopeNode*>(at_end ? node->children[node->childCount - 1].get() : node->children[0].get());
+    }
+
+    return true;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::concat(NodePtr left, NodePtr right, std::pmr::memory_resource* resource) -> NodePtr
+{
+    if (left->size == 0) {
+        return right;
+    }
+
+    if (right->size == 0) {
+        return left;
+    }
+
+    countEvent(Event::Concat);
+    const auto left_height = left->height;
+    const auto right_height = right->height;
+
+    if (left_height < right_height) {
+        auto right_children = right->childNodes();
+
+        if (left_height == right_height - 1 && !left->isUnderfull()) {
+            return mergeNodes({&left, 1}, right_children, resource);
+        }
+
+        auto node = concat(left, right_children.front(), resource);
+
+        if (node->height == right_height - 1) {
+            return mergeNodes({&node, 1}, right_children.subspan(1), resource);
+        }
+
+        return mergeNodes(node->childNodes(), right_children.subspan(1), resource);
+    }
+
+    if (left_height > right_height) {
+        auto left_children = left->childNodes();
+
+        if (right_height == left_height - 1 && !right->isUnderfull()) {
+            return mergeNodes(left_children, {&right, 1}, resource);
+        }
+
+        auto node = concat(left_children.back(), right, resource);
+
+        if (node->height == left_height - 1) {
+            return mergeNodes(left_children.first(left_children.size() - 1), {&node, 1}, resource);
+        }
+
+        return mergeNodes(left_children.first(left_children.size() - 1), node->childNodes(), resource);
+    }
+
+    if (!left->isUnderfull() && !right->isUnderfull()) {
+        const std::array<NodePtr, 2> nodes{left, right};
+
+        return makeNode(nodes, resource);
+    }
+
+    countEvent(Event::Rebalance);
+
+    if (left->isLeaf()) {
+        return mergeLeaves(left, right, resource);
+    }
+
+    return mergeNodes(left->childNodes(), right->childNodes(), resource);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::makeNode(std::span<const NodePtr> nodes, std::pmr::memory_resource* resource) -> NodePtr
+{
+    if (nodes.empty()) {
+        return allocateNode(resource);
+    }
+
+    if (nodes.size() == 1) {
+        return nodes.front();
+    }
+
+    return allocateNode(resource, nodes);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::makeBuffer(std::string_view content, std::pmr::memory_resource* resource) -> BufferPtr
+{
+    if (content.empty()) {
+        return nullptr;
+    }
+
+    return allocateBuffer(resource, content, resource);
+}
+
+template <RopeUnit Unit>
+size_t BasicRope<Unit>::countLineBreaks(std::string_view content)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // sixteen bytes compared at once, the matches counted from the mask of the comparison
+    const auto line_break = _mm_set1_epi8('\n');
+
+    for (; i + 16 <= content.size(); i += 16) {
+        const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(content.data() + i));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, line_break)));
+        count += static_cast<size_t>(std::popcount(mask));
+    }
+#endif
+
+    return count + static_cast<size_t>(std::count(content.begin() + i, content.end(), '\n'));
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::compact(NodePtr node, std::pmr::memory_resource* resource) -> NodePtr
+{
+    if (node->isLeaf()) {
+        if (!node->isBufferSparse()) {
+            return node;
+        }
+
+        countEvent(Event::Compaction);
+
+        if constexpr (Unit::counted) {
+            if (node->hasCharCounts()) {
+                auto buffer = makeBuffer(node->text(), resource);
+                return allocateNode(
+                    resource, buffer, 0, node->size, node->chars.count, node->chars.checkpoints, resource);
+            }
+        }
+
+        return allocateNode(resource, node->text(), resource);
+    }
+
+    std::array<NodePtr, RopeNode::MAX_CHILDREN> children;
+    auto child_nodes = node->childNodes();
+    bool changed = false;
+
+    for (size_t i = 0; i < child_nodes.size(); ++i) {
+        children[i] = compact(child_nodes[i], resource);
+        changed = changed || children[i] != child_nodes[i];
+    }
+
+    if (!changed) {
+        return node;
+    }
+
+    return makeNode(std::span{children}.first(child_nodes.size()), resource);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::joinUnderfullLeaves(NodePtr node, std::pmr::memory_resource* resource) -> NodePtr
+{
+    auto leaves = node->collectLeaves();
+    auto underfull = [](const NodePtr& leaf) {
+        return leaf->size < RopeNode::MIN_LEAF_SIZE;
+    };
+
+    if (leaves.size() < 2 || std::none_of(leaves.begin(), leaves.end(), underfull)) {
+        return node;
+    }
+
+    // an underfull leaf takes the text of the leaves after it until the run is big enough, and the last run goes
+    // into the leaf before it; runs over MAX_LEAF_SIZE are cut again
+    std::vector<NodePtr> joined;
+    std::string run;
+
+    auto flush = [&]() {
+        countEvent(Event::Compaction);
+
+        auto run_leaves = makeLeaves(run, resource);
+        joined.insert(joined.end(), run_leaves.begin(), run_leaves.end());
+        run.clear();
+    };
+
+    for (const auto& leaf : leaves) {
+        if (run.empty() && !underfull(leaf)) {
+            joined.push_back(leaf);
+            continue;
+        }
+
+        run.append(leaf->text());
+
+        if (run.size() >= RopeNode::MIN_LEAF_SIZE) {
+            flush();
+        }
+    }
+
+    if (!run.empty()) {
+        if (!joined.empty()) {
+            run.insert(0, joined.back()->text());
+            joined.pop_back();
+        }
+
+        flush();
+    }
+
+    return doMerge(std::move(joined), resource);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::makeTree(std::string_view content, std::pmr::memory_resource* resource) -> NodePtr
+{
+    return doMerge(makeLeaves(content, resource), resource);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::makeLeaves(std::string_view content, std::pmr::memory_resource* resource) -> std::vector<NodePtr>
+{
+    // every leaf is a slice of a single copy of the content
+    auto buffer = makeBuffer(content, resource);
+
+    return sliceLeaves(buffer, leafBoundaries(content), resource);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::joinChunks(std::span<const std::string_view> chunks, std::pmr::memory_resource* resource)
+    -> BufferPtr
+{
+    std::pmr::string content{resource};
+    content.reserve(std::accumulate(chunks.begin(), chunks.end(), size_t{0}, [](size_t size, auto chunk) {
+        return size + chunk.size();
+    }));
+
+    for (auto chunk : chunks) {
+        content.append(chunk);
+    }
+
+    if (content.empty()) {
+        return nullptr;
+    }
+
+    return allocateBuffer(resource, std::move(content));
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::sliceLeaves(const BufferPtr& buffer,
+                                  std::span<const size_t> boundaries,
+                                  std::pmr::memory_resource* resource) -> std::vector<NodePtr>
+{
+    std::vector<NodePtr> leaves;
+    leaves.reserve(boundaries.size());
+    size_t start = 0;
+
+    for (auto end : boundaries) {
+        leaves.push_back(allocateNode(resource, buffer, start, end - start, resource));
+        start = end;
+    }
+
+    return leaves;
+}
+
+template <RopeUnit Unit>
+std::vector<size_t> BasicRope<Unit>::leafBoundaries(std::string_view content)
+{
+    std::vector<size_t> boundaries;
+
+    if (content.empty()) {
+        return boundaries;
+    }
+
+    // Leaves are cut a bit below MAX_LEAF_SIZE so that the ones built here can absorb small edits before having to
+    // be split again, while still staying above MIN_LEAF_SIZE. The content is never segmented as a whole: each cut
+    // only looks at the bytes right before it, preferring the end of a line, then two ASCII characters (always a
+    // grapheme boundary unless they are "\r\n"), and only segments a small window around it when neither is found.
+    // Ropes counting bytes can be cut anywhere.
+    constexpr size_t window = 128;
+    const auto cuts = evenBoundaries(content.size());
+    size_t start = 0;
+
+    for (const size_t cut : std::span{cuts}.first(cuts.size() - 1)) {
+        const size_t lower = std::max(start + 1, cut > window ? cut - window : 0);
+        size_t line_end = std::string::npos;
+        size_t ascii_pair = std::string::npos;
+
+        for (size_t position = cut; position >= lower && line_end == std::string::npos; --position) {
+            const auto before = static_cast<unsigned char>(content[position - 1]);
+            const auto after = static_cast<unsigned char>(content[position]);
+
+            if (before == '\n') {
+                line_end = position;
+            } else if (ascii_pair == std::string::npos && before < 0x80 && after < 0x80 &&
+                       !(before == '\r' && after == '\n')) {
+                ascii_pair = position;
+            }
+        }
+
+        size_t boundary = line_end != std::string::npos ? line_end : ascii_pair;
+
+        if (boundary == std::string::npos && !Unit::counted) {
+            boundary = cut;
+        }
+
+        if constexpr (Unit::counted) {
+            if (boundary == std::string::npos) {
+                // The first boundary found in the window may be wrong (it starts in the middle of a character), the
+                // following ones are not, as long as the window does not start in the middle of a run of flags.
+                const size_t from = Segmenter<Unit>::windowStart(content, lower, start);
+                auto slice = content.substr(from, std::min(content.size(), cut + window) - from);
+
+                Segmenter<Unit>::forEachStart(slice, [&](size_t offset) {
+                    if (from + offset > cut) {
+                        return false;
+                    }
+
+                    if (offset > 0) {
+                        boundary = from + offset;
+                    }
+
+                    return true;
+                });
+            }
+        }
+
+        if (boundary != std::string::npos) {
+            boundaries.push_back(boundary);
+            start = boundary;
+        }
+    }
+
+    boundaries.push_back(content.size());
+
+    return boundaries;
+}
+
+template <RopeUnit Unit>
+std::vector<size_t> BasicRope<Unit>::evenBoundaries(size_t size)
+{
+    constexpr size_t target_size = RopeNode::MAX_LEAF_SIZE - RopeNode::MIN_LEAF_SIZE;
+    const auto count = (size + target_size - 1) / target_size;
+    std::vector<size_t> boundaries;
+    boundaries.reserve(count);
+
+    for (size_t i = 1; i <= count; ++i) {
+        boundaries.push_back(size * i / count);
+    }
+
+    return boundaries;
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::mergeLeaves(NodePtr left, NodePtr right, std::pmr::memory_resource* resource) -> NodePtr
+{
+    std::string content;
+    content.reserve(left->size + right->size);
+    content.append(left->text());
+    content.append(right->text());
+
+    if (content.size() <= RopeNode::MAX_LEAF_SIZE) {
+        return allocateNode(resource, content, resource);
+    }
+
+    return makeTree(content, resource);
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::mergeNodes(std::span<const NodePtr> left,
+                                 std::span<const NodePtr> right,
+                                 std::pmr::memory_resource* resource) -> NodePtr
+{
+    std::vector<NodePtr> nodes;
+    nodes.reserve(left.size() + right.size());
+    nodes.insert(nodes.end(), left.begin(), left.end());
+    nodes.insert(nodes.end(), right.begin(), right.end());
+
+    if (nodes.size() <= RopeNode::MAX_CHILDREN) {
+        return makeNode(nodes, resource);
+    }
+
+    countEvent(Event::Rebalance);
+
+    // both halves end up with at least MIN_CHILDREN nodes
+    const auto split_point = std::min(RopeNode::MAX_CHILDREN, nodes.size() - RopeNode::MIN_CHILDREN);
+    const std::array<NodePtr, 2> halves{makeNode(std::span{nodes}.first(split_point), resource),
+                                              makeNode(std::span{nodes}.subspan(split_point), resource)};
+
+    return makeNode(halves, resource);
+}
+
+template <RopeUnit Unit>
+bool BasicRope<Unit>::isBalanced(NodePtr node) const
+{
+    // concat keeps every leaf at the same depth, so looking at the cached heights of the children is enough
+    auto children = node->childNodes();
+
+    return std::all_of(std::begin(children), std::end(children), [&node](const auto& child) {
+        return child->height + 1 == node->height;
+    });
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::doMerge(std::vector<NodePtr> nodes, std::pmr::memory_resource* resource) -> NodePtr
+{
+    if (nodes.empty()) {
+        return makeNode({}, resource);
+    }
+
+    // builds the tree bottom-up, one level at a time
+    while (nodes.size() > 1) {
+        nodes = makeParents(nodes, resource);
+    }
+
+    return nodes.front();
+}
+
+template <RopeUnit Unit>
+auto BasicRope<Unit>::makeParents(std::span<const NodePtr> nodes, std::pmr::memory_resource* resource)
+    -> std::vector<NodePtr>
+{
+    // the nodes are spread evenly between their parents, even when there are too few to fill one
+    const auto count = (nodes.size() + RopeNode::MAX_CHILDREN - 1) / RopeNode::MAX_CHILDREN;
+    std::vector<NodePtr> parents;
+    parents.reserve(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        const auto begin = nodes.size() * i / count;
+        const auto end = nodes.size() * (i + 1) / count;
+
+        parents.push_back(allocateNode(resource, nodes.subspan(begin, end - begin)));
+    }
+
+    return parents;
+}
+
+template struct BasicRope<metrics::Bytes>;
+template struct BasicRope<metrics::CodePoints>;
+
+#ifndef W5N_ROPE_UTF8_IGNORE
+template struct BasicRope<metrics::Graphemes>;
+#endif
+
 } // namespace w5n
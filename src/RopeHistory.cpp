@@ -0,0 +1,151 @@
+#include "w5n/RopeHistory.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace w5n {
+
+RopeHistory::RopeHistory(size_t capacity) : position(0), limit(std::max<size_t>(capacity, 1))
+{
+}
+
+void RopeHistory::record(const Rope& rope)
+{
+    if (!versions.empty()) {
+        versions.erase(versions.begin() + static_cast<std::ptrdiff_t>(position) + 1, versions.end());
+    }
+
+    versions.push_back(rope.snapshot());
+
+    if (versions.size() > limit) {
+        versions.pop_front();
+    }
+
+    position = versions.size() - 1;
+}
+
+std::optional<Rope> RopeHistory::undo()
+{
+    if (!canUndo()) {
+        return std::nullopt;
+    }
+
+    --position;
+
+    return versions[position].snapshot();
+}
+
+std::optional<Rope> RopeHistory::redo()
+{
+    if (!canRedo()) {
+        return std::nullopt;
+    }
+
+    ++position;
+
+    return versions[position].snapshot();
+}
+
+bool RopeHistory::canUndo() const
+{
+    return position > 0;
+}
+
+bool RopeHistory::canRedo() const
+{
+    return position + 1 < versions.size();
+}
+
+std::optional<Rope> RopeHistory::current() const
+{
+    if (versions.empty()) {
+        return std::nullopt;
+    }
+
+    return versions[position].snapshot();
+}
+
+size_t RopeHistory::size() const
+{
+    return versions.size();
+}
+
+size_t RopeHistory::capacity() const
+{
+    return limit;
+}
+
+void RopeHistory::clear()
+{
+    versions.clear();
+    position = 0;
+}
+
+std::vector<size_t> RopeHistory::uniqueBytes() const
+{
+    // Every node and buffer is owned by the first version reaching it, until a second one does and it becomes shared.
+    // A subtree is only walked again when it turns shared, so versions sharing most of their nodes are cheap to visit.
+    constexpr size_t shared = std::numeric_limits<size_t>::max();
+    std::unordered_map<const Rope::RopeNode*, size_t> node_owners;
+    std::unordered_map<const Rope::LeafBuffer*, size_t> buffer_owners;
+
+    auto claim = [](auto& owners, const auto* key, size_t version) {
+        auto [it, inserted] = owners.try_emplace(key, version);
+
+        if (inserted) {
+            return true;
+        }
+
+        if (it->second == version || it->second == shared) {
+            return false;
+        }
+
+        it->second = shared;
+
+        return true;
+    };
+
+    std::vector<const Rope::RopeNode*> pending;
+
+    for (size_t version = 0; version < versions.size(); ++version) {
+        pending.push_back(versions[version].root.get());
+
+        while (!pending.empty()) {
+            const auto* node = pending.back();
+            pending.pop_back();
+
+            if (!claim(node_owners, node, version)) {
+                continue;
+            }
+
+            if (node->buffer != nullptr) {
+                claim(buffer_owners, node->buffer.get(), version);
+            }
+
+            for (const auto& child : node->childNodes()) {
+                pending.push_back(child.get());
+            }
+        }
+    }
+
+    std::vector<size_t> result(versions.size(), 0);
+
+    for (const auto& [node, owner] : node_owners) {
+        if (owner != shared) {
+            result[owner] += node->memoryUsage();
+        }
+    }
+
+    for (const auto& [buffer, owner] : buffer_owners) {
+        if (owner != shared) {
+            result[owner] += sizeof(Rope::LeafBuffer) + buffer->storage.capacity();
+        }
+    }
+
+    return result;
+}
+
+} // namespace w5n
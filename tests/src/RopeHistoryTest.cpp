@@ -0,0 +1,92 @@
+#include "w5n/RopeHistory.hpp"
+
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(RopeHistoryTest, It_Undoes_And_Redoes_Edits)
+{
+    w5n::Rope r;
+    w5n::RopeHistory history;
+    history.record(r);
+
+    r.append("Hello");
+    history.record(r);
+    r.append(" World");
+    history.record(r);
+
+    ASSERT_FALSE(history.canRedo());
+    ASSERT_TRUE(history.canUndo());
+
+    r = *history.undo();
+    ASSERT_EQ("Hello", r.toString());
+    r = *history.undo();
+    ASSERT_EQ("", r.toString());
+    ASSERT_FALSE(history.undo().has_value());
+
+    r = *history.redo();
+    ASSERT_EQ("Hello", r.toString());
+
+    // recording after an undo drops the versions that could be redone
+    r.append(", Rope");
+    history.record(r);
+    ASSERT_FALSE(history.canRedo());
+    ASSERT_EQ(3, history.size());
+    ASSERT_EQ("Hello, Rope", history.current()->toString());
+}
+
+TEST(RopeHistoryTest, It_Keeps_Snapshots_Unchanged)
+{
+    w5n::Rope r;
+    r.append("Hello");
+
+    auto snapshot = r.snapshot();
+    r.append(" World");
+    r.erase(0, 1);
+
+    ASSERT_EQ("Hello", snapshot.toString());
+    ASSERT_EQ("ello World", r.toString());
+}
+
+TEST(RopeHistoryTest, It_Drops_The_Oldest_Versions)
+{
+    w5n::Rope r;
+    w5n::RopeHistory history{3};
+
+    for (char c = 'a'; c <= 'e'; ++c) {
+        r.append(std::string(1, c));
+        history.record(r);
+    }
+
+    ASSERT_EQ(3, history.size());
+    ASSERT_EQ("abcd", history.undo()->toString());
+    ASSERT_EQ("abc", history.undo()->toString());
+    ASSERT_FALSE(history.canUndo());
+}
+
+TEST(RopeHistoryTest, It_Reports_The_Memory_Held_By_Each_Version)
+{
+    std::string line(100, 'x');
+    line += '\n';
+    w5n::Rope r;
+
+    for (size_t i = 0; i < 1000; ++i) {
+        r.append(line);
+    }
+
+    w5n::RopeHistory history;
+    history.record(r);
+    r.insert(50000, "typing");
+    history.record(r);
+
+    auto bytes = history.uniqueBytes();
+    ASSERT_EQ(2, bytes.size());
+
+    // only the path to the edited leaf differs between the two versions
+    ASSERT_GT(bytes[1], 0);
+    ASSERT_LT(bytes[1], 16 * 1024);
+    ASSERT_LT(bytes[0], 16 * 1024);
+
+    w5n::RopeHistory single;
+    single.record(r);
+    ASSERT_GT(single.uniqueBytes().front(), r.size());
+}
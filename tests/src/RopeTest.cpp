@@ -1,6 +1,26 @@
 #include "w5n/Rope.hpp"
 
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <iterator>
+#include <memory_resource>
+#include <numeric>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+static_assert(std::ranges::bidirectional_range<w5n::Rope>);
+static_assert(std::bidirectional_iterator<w5n::Rope::ByteIterator>);
+
+template <typename Rope>
+concept CountsChars = requires(const Rope& rope) { rope.charCount(); };
 
 TEST(RopeTest, It_Appends_Correctly)
 {
@@ -132,7 +152,1024 @@ TEST(RopeTest, It_Gets_Correct_Character)
 #endif
 }
 
+TEST(RopeTest, It_Handles_Content_Bigger_Than_A_Leaf)
+{
+    std::string expected;
+    for (size_t i = 0; i < 100000; ++i) {
+        expected += static_cast<char>('a' + i % 26);
+    }
+
+    w5n::Rope r;
+    r.append(expected);
+    ASSERT_EQ(expected, r.toString());
+
+    r.insert(50000, "Test");
+    expected.insert(50000, "Test");
+    ASSERT_EQ(expected, r.toString());
+
+    r.erase(10000, 70000);
+    expected.erase(10000, 70000);
+    ASSERT_EQ(expected, r.toString());
+    ASSERT_EQ(expected.substr(9000, 3000), r.substring(9000, 3000));
+    ASSERT_TRUE(r.isBalanced());
+}
+
+TEST(RopeTest, It_Stays_Balanced_With_Many_Small_Appends)
+{
+    w5n::Rope r;
+    std::string expected;
+
+    for (size_t i = 0; i < 10000; ++i) {
+        r.append("ab");
+        expected += "ab";
+    }
+
+    ASSERT_TRUE(r.isBalanced());
+    ASSERT_EQ(expected, r.toString());
+}
+
+TEST(RopeTest, It_Reports_Its_Depth)
+{
+    w5n::Rope r;
+    ASSERT_EQ(1, r.depth());
+
+    r.append("small");
+    ASSERT_EQ(1, r.depth());
+
+    // more full leaves (4 KiB) than a node has children (16)
+    r.append(std::string(17 * 4096, 'a'));
+    ASSERT_EQ(3, r.depth());
+
+    r.erase(0, r.size() - 10);
+    ASSERT_EQ(1, r.depth());
+}
+
+TEST(RopeTest, It_Stays_Balanced_With_Edits_In_The_Middle)
+{
+    w5n::Rope r;
+    std::string expected;
+
+    for (size_t i = 0; i < 5000; ++i) {
+        const auto position = (i * 7919) % (expected.size() + 1);
+        r.insert(position, "abc");
+        expected.insert(position, "abc");
+
+        if (i % 3 == 0) {
+            r.erase(position / 2, 2);
+            expected.erase(position / 2, 2);
+        }
+
+        ASSERT_TRUE(r.isBalanced());
+    }
+
+    ASSERT_EQ(expected, r.toString());
+}
+
+TEST(RopeTest, It_Allocates_From_The_Given_Memory_Resource)
+{
+    std::pmr::unsynchronized_pool_resource pool;
+    std::string expected(10000, 'a');
+    std::string result;
+
+    // anything reaching for the default resource would throw
+    auto previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    {
+        w5n::Rope r{&pool};
+        r.append(expected);
+        r.insert(5000, "Test");
+        r.erase(100, 2000);
+
+        result = r.toString();
+    }
+    std::pmr::set_default_resource(previous);
+
+    expected.insert(5000, "Test");
+    expected.erase(100, 2000);
+    ASSERT_EQ(expected, result);
+}
+
+TEST(RopeTest, It_Keeps_Copies_Independent)
+{
+    w5n::Rope r;
+    r.append(std::string(20000, 'a'));
+
+    w5n::Rope copy = r;
+    r.erase(100, 15000);
+    copy.insert(10, "Test");
+
+    ASSERT_EQ(5000, r.size());
+    ASSERT_EQ(20004, copy.size());
+    ASSERT_EQ("aaTesta", copy.substring(8, 7));
+
+    copy = r;
+    r.clear();
+    ASSERT_EQ(std::string(5000, 'a'), copy.toString());
+}
+
+TEST(RopeTest, It_Keeps_Content_After_Compacting)
+{
+    std::string content;
+    for (size_t i = 0; i < 50000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    w5n::Rope r;
+    r.append(content);
+    r.erase(10, 49900);
+    r.compact();
+
+    ASSERT_EQ(content.substr(0, 10) + content.substr(49910), r.toString());
+    ASSERT_TRUE(r.insert(5, "Test"));
+    ASSERT_EQ("abcdeTestfghij", r.substring(0, 14));
+}
+
+TEST(RopeTest, It_Iterates_Over_Bytes)
+{
+    std::string content;
+    for (size_t i = 0; i < 20000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    w5n::Rope r;
+    r.append(content);
+    r.insert(10000, "Test");
+    content.insert(10000, "Test");
+
+    auto bytes = r.bytes();
+    ASSERT_EQ(content, std::string(bytes.begin(), bytes.end()));
+    ASSERT_TRUE(std::ranges::equal(content | std::views::reverse, bytes | std::views::reverse));
+
+    auto it = std::ranges::find(bytes, 'T');
+    ASSERT_EQ(10000, it.offset());
+    ASSERT_EQ('p', *std::prev(it));
+}
+
+TEST(RopeTest, It_Iterates_Over_An_Empty_Rope)
+{
+    w5n::Rope r;
+    ASSERT_TRUE(r.begin() == r.end());
+    ASSERT_TRUE(r.bytes().empty());
+}
+
+TEST(RopeTest, It_Finds_Matches_Across_Leaves)
+{
+    std::string content;
+    for (size_t i = 0; i < 30000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    w5n::Rope r;
+    r.append(content);
+
+    for (size_t offset : {0, 1, 4095, 4096, 10000, 29990}) {
+        auto needle = content.substr(offset, 10);
+        ASSERT_EQ(content.find(needle, offset), r.find(needle, offset));
+        ASSERT_EQ(content.rfind(needle, offset), r.rfind(needle, offset));
+    }
+
+    auto needle = content.substr(3000, 6000);
+    ASSERT_EQ(content.find(needle), r.find(needle));
+    ASSERT_EQ(content.rfind(needle), r.rfind(needle));
+
+    ASSERT_EQ(std::string::npos, r.find("ba"));
+    ASSERT_EQ(std::string::npos, r.rfind("ba"));
+    ASSERT_EQ(content.size(), r.find("", content.size()));
+
+    auto matches = r.findAll("xyz");
+    ASSERT_EQ(30000 / 26, matches.size());
+    for (size_t i = 0; i < matches.size(); ++i) {
+        ASSERT_EQ(23 + i * 26, matches[i]);
+    }
+}
+
+TEST(RopeTest, It_Does_Not_Overlap_Matches)
+{
+    w5n::Rope r;
+    r.append("aaaaa");
+
+    ASSERT_EQ((std::vector<size_t>{0, 2}), r.findAll("aa"));
+    ASSERT_EQ(3, r.rfind("aa"));
+}
+
+TEST(RopeTest, It_Streams_Its_Leaves)
+{
+    std::string content;
+    for (size_t i = 0; i < 50000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    w5n::Rope r;
+    r.append(content);
+    r.insert(20000, "Test");
+    content.insert(20000, "Test");
+
+    std::string chunks;
+    size_t count = 0;
+    r.forEachChunk([&](std::string_view chunk) {
+        chunks.append(chunk);
+        ++count;
+    });
+    ASSERT_EQ(content, chunks);
+    ASSERT_GT(count, 1);
+
+    std::ostringstream stream;
+    r.writeTo(stream);
+    ASSERT_EQ(content, stream.str());
+
+#ifndef _WIN32
+    auto file = std::tmpfile();
+    ASSERT_NE(nullptr, file);
+    ASSERT_TRUE(r.writeTo(fileno(file)));
+
+    std::string written(content.size(), '\0');
+    std::rewind(file);
+    ASSERT_EQ(content.size(), std::fread(written.data(), 1, written.size(), file));
+    ASSERT_EQ(content, written);
+    std::fclose(file);
+#endif
+}
+
+TEST(RopeTest, It_Copies_Ranges_Into_A_Buffer)
+{
+    std::string content;
+    for (size_t i = 0; i < 20000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    w5n::Rope r;
+    r.append(content);
+
+    std::string buffer(6000, '\0');
+    ASSERT_EQ(6000, r.copyTo(buffer, 3000, 8000));
+    ASSERT_EQ(content.substr(3000, 6000), buffer);
+
+    ASSERT_EQ(100, r.copyTo(buffer, 19900, 500));
+    ASSERT_EQ(content.substr(19900), buffer.substr(0, 100));
+    ASSERT_EQ(0, r.copyTo(buffer, 30000, 10));
+}
+
+TEST(RopeTest, It_Views_Ranges_Inside_A_Leaf)
+{
+    std::string content;
+    for (size_t i = 0; i < 20000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    w5n::Rope r;
+    r.append(content);
+
+    auto view = r.view(10, 20);
+    ASSERT_TRUE(view.has_value());
+    ASSERT_EQ(content.substr(10, 20), *view);
+
+    ASSERT_FALSE(r.view(0, 20000).has_value());
+    ASSERT_EQ("", r.view(20000, 10).value());
+}
+
+TEST(RopeTest, It_Maps_Offsets_To_Lines)
+{
+    std::string content;
+    std::vector<size_t> starts{0};
+    for (size_t i = 0; i < 5000; ++i) {
+        content += "line " + std::to_string(i) + (i % 2 == 0 ? "\n" : "\r\n");
+        starts.push_back(content.size());
+    }
+
+    w5n::Rope r;
+    r.append(content);
+
+    ASSERT_EQ(5001, r.lineCount());
+    for (size_t line = 0; line < starts.size(); line += 7) {
+        ASSERT_EQ(starts[line], r.lineStart(line));
+
+        auto position = r.offsetToLineCol(starts[line] + 2);
+        ASSERT_EQ(line, position.line);
+        ASSERT_EQ(line + 1 < starts.size() ? 2 : 0, position.column);
+    }
+    ASSERT_EQ(std::string::npos, r.lineStart(5001));
+
+    ASSERT_EQ(starts[40] + 3, r.lineColToOffset(40, 3));
+    ASSERT_EQ(starts[41] - 1, r.lineColToOffset(40, 100));
+    ASSERT_EQ(content.size(), r.lineColToOffset(5000, 10));
+    ASSERT_EQ(std::string::npos, r.lineColToOffset(5001, 0));
+
+    r.eraseBytes(starts[10], starts[20] - starts[10]);
+    ASSERT_EQ(4991, r.lineCount());
+    ASSERT_EQ(starts[10], r.lineStart(10));
+    ASSERT_EQ(content.substr(starts[20], 7), r.substringBytes(r.lineStart(10), 7));
+}
+
+TEST(RopeTest, It_Applies_Many_Edits_At_Once)
+{
+    std::string content;
+    for (size_t i = 0; i < 100000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    w5n::Rope r;
+    r.append(content);
+
+    std::vector<w5n::Rope::Edit> edits;
+    std::string expected;
+    size_t end = 0;
+    for (size_t offset = 10; offset < content.size(); offset += 97) {
+        const size_t size = offset % 5;
+        const std::string_view text = offset % 3 == 0 ? "" : "Test";
+
+        expected.append(content, end, offset - end);
+        expected.append(text);
+        edits.push_back({offset, size, text});
+        end = offset + size;
+    }
+    expected.append(content, end);
+
+    ASSERT_TRUE(r.applyEdits(edits));
+    ASSERT_EQ(expected, r.toString());
+    ASSERT_TRUE(r.isBalanced());
+}
+
+TEST(RopeTest, It_Rejects_Unordered_Edits)
+{
+    w5n::Rope r;
+    r.append("Hello World");
+
+    const std::array<w5n::Rope::Edit, 2> overlapping{{{0, 5, "Bye"}, {3, 1, "!"}}};
+    ASSERT_FALSE(r.applyEdits(overlapping));
+
+    const std::array<w5n::Rope::Edit, 1> past_the_end{{{10, 5, ""}}};
+    ASSERT_FALSE(r.applyEdits(past_the_end));
+    ASSERT_EQ("Hello World", r.toString());
+
+    const std::array<w5n::Rope::Edit, 2> edits{{{0, 5, "Bye"}, {11, 0, "!"}}};
+    ASSERT_TRUE(r.applyEdits(edits));
+    ASSERT_EQ("Bye World!", r.toString());
+}
+
+TEST(RopeTest, It_Applies_Edits_Spanning_Many_Leaves)
+{
+    std::string content;
+    for (size_t i = 0; i < 200000; ++i) {
+        content.push_back(static_cast<char>('a' + i % 26));
+    }
+
+    auto r = w5n::Rope::fromString(content);
+    auto copy = r.snapshot();
+
+    const std::string inserted(30000, 'x');
+    const std::array<w5n::Rope::Edit, 4> edits{
+        {{0, 0, "start"}, {1000, 50000, ""}, {60000, 0, inserted}, {100000, 100000, "end"}}};
+
+    std::string expected = content;
+    expected.replace(100000, 100000, "end");
+    expected.insert(60000, inserted);
+    expected.erase(1000, 50000);
+    expected.insert(0, "start");
+
+    ASSERT_TRUE(r.applyEdits(edits));
+    ASSERT_EQ(expected, r.toString());
+    ASSERT_EQ(content, copy.toString());
+    ASSERT_TRUE(r.isBalanced());
+    ASSERT_LE(r.depth(), w5n::Rope::fromString(expected).depth() + 1);
+
+    // the leaves no edit falls into are still shared with the copy
+    ASSERT_GT(r.stats().sharedBytes, 0);
+
+    const std::array<w5n::Rope::Edit, 1> everything{{{0, expected.size(), "new"}}};
+    ASSERT_TRUE(r.applyEdits(everything));
+    ASSERT_EQ("new", r.toString());
+    ASSERT_EQ(1, r.depth());
+}
+
+TEST(RopeTest, It_Inserts_At_The_End_After_Erasing_To_It)
+{
+    const std::string content(10000, 'a');
+    const std::array<w5n::Rope::Edit, 3> edits{{{50, 9950, ""}, {10000, 0, "X"}, {10000, 0, "YZ"}}};
+
+    auto r = w5n::Rope::fromString(content);
+    ASSERT_GT(r.depth(), 1);
+    ASSERT_TRUE(r.applyEdits(edits));
+    ASSERT_EQ(std::string(50, 'a') + "XYZ", r.toString());
+
+    auto small = w5n::Rope::fromString(content.substr(0, 100));
+    const std::array<w5n::Rope::Edit, 2> small_edits{{{50, 50, ""}, {100, 0, "X"}}};
+    ASSERT_TRUE(small.applyEdits(small_edits));
+    ASSERT_EQ(std::string(50, 'a') + "X", small.toString());
+}
+
+TEST(RopeTest, It_Edits_By_Byte_Offset)
+{
+    w5n::Rope r;
+    r.append("Hello World");
+
+    ASSERT_TRUE(r.insertAtByte(5, ","));
+    ASSERT_EQ("Hello, World", r.toString());
+
+    ASSERT_TRUE(r.eraseBytes(0, 7));
+    ASSERT_EQ("World", r.toString());
+
+    ASSERT_FALSE(r.insertAtByte(10, "!"));
+    ASSERT_EQ("orl", r.substringBytes(1, 3));
+    ASSERT_EQ("ld", r.substringBytes(3));
+}
+
+static std::filesystem::path writeTemporaryFile(const std::string& name, const std::string& content)
+{
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream{path, std::ios::binary} << content;
+    return path;
+}
+
+TEST(RopeTest, It_Loads_A_File)
+{
+    std::string content;
+
+    for (size_t i = 0; i < 5000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+
+    auto path = writeTemporaryFile("w5n-rope-test-load.txt", content);
+    auto r = w5n::Rope::fromFile(path);
+    ASSERT_TRUE(r.has_value());
+    ASSERT_EQ(content, r->toString());
+    ASSERT_EQ(5001, r->lineCount());
+    ASSERT_EQ(content.find("line 4321"), r->lineStart(4321));
+
+    // the file can go away, the mapping stays valid
+    std::filesystem::remove(path);
+    r->insertAtByte(0, "first\n");
+    r->append("last");
+    ASSERT_EQ("first\n" + content + "last", r->toString());
+
+    ASSERT_FALSE(w5n::Rope::fromFile(path).has_value());
+    ASSERT_EQ(0, w5n::Rope::fromFile(writeTemporaryFile("w5n-rope-test-empty.txt", ""))->size());
+}
+
+TEST(RopeTest, It_Appends_One_Character_At_A_Time)
+{
+    w5n::Rope r;
+    std::string expected;
+    w5n::Rope copy;
+    std::string copied;
+
+    for (size_t i = 0; i < 20000; ++i) {
+        const char c = static_cast<char>('a' + i % 26);
+        r.append(std::string_view{&c, 1});
+        r.prepend(std::string_view{&c, 1});
+        expected = c + expected + c;
+
+        if (i == 10000) {
+            copy = r;
+            copied = expected;
+        }
+    }
+
+    ASSERT_EQ(expected, r.toString());
+    ASSERT_EQ(copied, copy.toString());
+    ASSERT_TRUE(r.isBalanced());
+
+    auto it = r.bytes().begin();
+    r.append("!");
+    ASSERT_EQ(expected.front(), *it);
+    ASSERT_EQ('!', r.toString().back());
+}
+
+TEST(RopeTest, It_Keeps_Small_Ropes_Small_When_Appending)
+{
+    w5n::Rope r;
+    r.append("x");
+    ASSERT_LT(r.stats().exclusiveBytes, 1024);
+
+    // the room left after the text grows as it does, up to a whole leaf
+    std::string expected = "x";
+
+    for (size_t i = 0; i < 3000; ++i) {
+        r.append("y");
+        r.prepend("z");
+        expected = "z" + expected + "y";
+    }
+
+    ASSERT_EQ(expected, r.toString());
+    ASSERT_TRUE(r.isBalanced());
+}
+
+TEST(RopeTest, It_Builds_From_Chunks)
+{
+    std::vector<std::string> lines;
+    std::string expected;
+
+    for (size_t i = 0; i < 20000; ++i) {
+        lines.push_back("line " + std::to_string(i) + "\n");
+        expected += lines.back();
+    }
+
+    std::vector<std::string_view> chunks{lines.begin(), lines.end()};
+    auto r = w5n::Rope::fromChunks(chunks);
+
+    ASSERT_EQ(expected, r.toString());
+    ASSERT_EQ(20001, r.lineCount());
+    ASSERT_TRUE(r.isBalanced());
+    ASSERT_EQ(expected, w5n::Rope::fromString(expected).toString());
+    ASSERT_EQ(0, w5n::Rope::fromChunks({}).size());
+}
+
+TEST(RopeTest, It_Splices_Ropes)
+{
+    std::string text;
+
+    for (size_t i = 0; i < 50000; ++i) {
+        text += std::to_string(i) + ' ';
+    }
+
+    w5n::Rope document;
+    document.append(text);
+    w5n::Rope other;
+    other.append("<<>>");
+
+    auto block = document.extractBytes(1000, 100000);
+    ASSERT_TRUE(block.has_value());
+    ASSERT_EQ(text.substr(1000, 100000), block->toString());
+    ASSERT_EQ(text.substr(0, 1000) + text.substr(101000), document.toString());
+
+    ASSERT_TRUE(other.insertAtByte(2, *block));
+    ASSERT_EQ("<<" + text.substr(1000, 100000) + ">>", other.toString());
+
+    // the block is shared, editing one copy leaves the other alone
+    block->append("!");
+    ASSERT_EQ(100001, block->size());
+    ASSERT_EQ(100000 + 4, other.size());
+
+    other.append(other);
+    other.prepend(document);
+    ASSERT_EQ(document.size() + 2 * (100000 + 4), other.size());
+    ASSERT_TRUE(other.isBalanced());
+}
+
+TEST(RopeTest, It_Moves_Ranges)
+{
+    w5n::Rope r;
+    r.append("0123456789");
+
+    ASSERT_TRUE(r.moveBytes(2, 3, 8));
+    ASSERT_EQ("0156723489", r.toString());
+
+    ASSERT_TRUE(r.moveBytes(5, 3, 0));
+    ASSERT_EQ("2340156789", r.toString());
+
+    ASSERT_TRUE(r.move(0, 2, 10));
+    ASSERT_EQ("4015678923", r.toString());
+
+    ASSERT_FALSE(r.moveBytes(2, 5, 4));
+    ASSERT_FALSE(r.moveBytes(2, 5, 11));
+    ASSERT_EQ("4015678923", r.toString());
+}
+
+TEST(RopeTest, It_Reports_Its_Shape_And_Memory)
+{
+    auto r = w5n::Rope::fromString(std::string(100000, 'a'));
+    auto stats = r.stats();
+
+    ASSERT_EQ(r.depth(), stats.depth);
+    ASSERT_GT(stats.nodes, stats.leaves);
+    ASSERT_EQ(stats.leaves, std::accumulate(stats.leafSizes.begin(), stats.leafSizes.end(), size_t{0}));
+    ASSERT_EQ(0, stats.sharedBytes);
+    ASSERT_GE(stats.exclusiveBytes, 100000);
+    ASSERT_EQ(0, stats.mappedBytes);
+    ASSERT_EQ(0, stats.unreferencedBytes);
+
+    // a copy shares every node, until one of them is edited
+    auto copy = r;
+    ASSERT_EQ(0, r.stats().exclusiveBytes);
+    ASSERT_EQ(stats.exclusiveBytes, r.stats().sharedBytes);
+
+    copy.insert(50000, "b");
+    ASSERT_GT(r.stats().exclusiveBytes, 0);
+    ASSERT_GT(r.stats().sharedBytes, 0);
+
+    // what the erased text leaves behind in the buffer is released by compact
+    r.erase(2048, 90000);
+    copy.clear();
+    ASSERT_EQ(90000, r.stats().unreferencedBytes);
+
+    r.compact();
+    ASSERT_EQ(0, r.stats().unreferencedBytes);
+}
+
+static void writeVarint(std::string& out, size_t value)
+{
+    for (; value >= 0x80; value >>= 7) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+    }
+
+    out += static_cast<char>(value);
+}
+
+// A serialized rope written by hand, with counts of the given unit (0 for none, 1 for graphemes).
+static std::string serializedRope(char counts, std::string_view text, std::string_view tree)
+{
+    std::string data{"W5NR\x01"};
+    data += counts;
+    writeVarint(data, text.size());
+    data += text;
+    writeVarint(data, tree.size());
+    data += tree;
+
+    return data;
+}
+
+TEST(RopeTest, It_Joins_Underfull_Leaves_When_Compacting)
+{
+    // a serialized tree of eleven leaves, four of them under the minimum size, and two of those next to each other
+    const std::array<size_t, 11> sizes{100, 2000, 2000, 300, 200, 2000, 2000, 4000, 2000, 2000, 50};
+    std::string expected;
+    std::string tree;
+    writeVarint(tree, sizes.size());
+
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        expected.append(sizes[i], static_cast<char>('a' + i));
+        writeVarint(tree, 0);
+        writeVarint(tree, sizes[i]);
+        writeVarint(tree, 0);
+    }
+
+    const auto data = serializedRope(0, expected, tree);
+    std::istringstream stream{data};
+    auto r = w5n::Rope::deserialize(stream);
+    ASSERT_TRUE(r.has_value());
+    ASSERT_EQ(4, r->stats().underfullLeaves);
+
+    auto copy = *r;
+    r->compact();
+
+    ASSERT_EQ(0, r->stats().underfullLeaves);
+    ASSERT_EQ(expected, r->toString());
+    ASSERT_EQ(expected.size(), r->size());
+    ASSERT_EQ(expected.substr(4050, 500), r->substring(4050, 500));
+    ASSERT_EQ(4, copy.stats().underfullLeaves);
+    ASSERT_EQ(expected, copy.toString());
+}
+
+TEST(RopeTest, It_Serializes_And_Restores_The_Tree)
+{
+    std::string expected;
+
+    for (size_t i = 0; expected.size() < 200000; ++i) {
+        expected += "line " + std::to_string(i) + "\n";
+    }
+
+    w5n::Rope r;
+    r.append(expected);
+
+    for (size_t i = 0; i < 200; ++i) {
+        const auto position = (i * 7919) % expected.size();
+        r.insertAtByte(position, "edit");
+        expected.insert(position, "edit");
+    }
+
+    r.lineCount();
+    std::stringstream stream;
+    ASSERT_TRUE(r.serialize(stream));
+
+    auto restored = w5n::Rope::deserialize(stream);
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(expected, restored->toString());
+    ASSERT_EQ(r.depth(), restored->depth());
+    ASSERT_EQ(r.stats().leafSizes, restored->stats().leafSizes);
+    ASSERT_EQ(r.lineCount(), restored->lineCount());
+    ASSERT_EQ(r.lineStart(1000), restored->lineStart(1000));
+    ASSERT_TRUE(restored->isBalanced());
+
+    restored->insert(10, "more");
+    ASSERT_EQ(expected.insert(10, "more"), restored->toString());
+}
+
+TEST(RopeTest, It_Serializes_Several_Ropes_To_One_Stream)
+{
+    w5n::Rope empty;
+    auto text = w5n::Rope::fromString(std::string(10000, 'x'));
+    std::stringstream stream;
+
+    ASSERT_TRUE(empty.serialize(stream));
+    ASSERT_TRUE(text.serialize(stream));
+
+    ASSERT_EQ("", w5n::Rope::deserialize(stream)->toString());
+    ASSERT_EQ(text.toString(), w5n::Rope::deserialize(stream)->toString());
+    ASSERT_FALSE(w5n::Rope::deserialize(stream).has_value());
+}
+
+TEST(RopeTest, It_Rejects_Invalid_Serialized_Data)
+{
+    auto r = w5n::Rope::fromString(std::string(20000, 'x') + "\n");
+    r.lineCount();
+    std::stringstream stream;
+    r.serialize(stream);
+    const auto data = stream.str();
+
+    for (size_t size = 0; size < data.size(); size += 7) {
+        std::istringstream truncated{data.substr(0, size)};
+        ASSERT_FALSE(w5n::Rope::deserialize(truncated).has_value());
+    }
+
+    auto version = data;
+    version[4] = 2;
+    std::istringstream unknown_version{version};
+    ASSERT_FALSE(w5n::Rope::deserialize(unknown_version).has_value());
+
+    std::istringstream text{"not a rope"};
+    ASSERT_FALSE(w5n::Rope::deserialize(text).has_value());
+
+    // a leaf of 2000 bytes and 1999 graphemes with its counts, the given checkpoints (index and offset) and a
+    // checkpoint every 16 graphemes when none are given
+    const auto leaf = std::string(15, 'a') + "\xC3\xA9" + std::string(1983, 'b');
+    using Checkpoints = std::vector<std::pair<size_t, size_t>>;
+    Checkpoints every_16th;
+
+    for (size_t index = 0; index < 1999; index += 16) {
+        every_16th.emplace_back(index, index < 16 ? index : index + 1);
+    }
+
+    auto serializedLeaf = [&leaf](size_t line_breaks, size_t char_count, const Checkpoints& checkpoints) {
+        std::string tree;
+        writeVarint(tree, 0);
+        writeVarint(tree, leaf.size());
+        writeVarint(tree, 1);
+        writeVarint(tree, line_breaks);
+        writeVarint(tree, char_count);
+        writeVarint(tree, checkpoints.size());
+        std::pair<size_t, size_t> previous{0, 0};
+
+        for (auto checkpoint : checkpoints) {
+            writeVarint(tree, checkpoint.first - previous.first);
+            writeVarint(tree, checkpoint.second - previous.second);
+            previous = checkpoint;
+        }
+
+        return std::istringstream{serializedRope(1, leaf, tree)};
+    };
+
+    auto valid = serializedLeaf(0, 1999, every_16th);
+    auto restored = w5n::Rope::deserialize(valid);
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(leaf, restored->toString());
+    ASSERT_EQ("b", restored->substring(50, 1));
+
+    auto none = serializedLeaf(0, 1999, {});
+    ASSERT_FALSE(w5n::Rope::deserialize(none).has_value());
+
+    auto no_characters = serializedLeaf(0, 0, {});
+    ASSERT_FALSE(w5n::Rope::deserialize(no_characters).has_value());
+
+    auto missing = serializedLeaf(0, 1999, Checkpoints(every_16th.begin(), every_16th.end() - 1));
+    ASSERT_FALSE(w5n::Rope::deserialize(missing).has_value());
+
+    auto repeated = every_16th;
+    repeated[2] = repeated[1];
+    auto repeated_stream = serializedLeaf(0, 1999, repeated);
+    ASSERT_FALSE(w5n::Rope::deserialize(repeated_stream).has_value());
+
+    // checkpoints more than 16 graphemes apart
+    auto gap = every_16th;
+    gap.erase(gap.begin() + 1);
+    auto gap_stream = serializedLeaf(0, 1999, gap);
+    ASSERT_FALSE(w5n::Rope::deserialize(gap_stream).has_value());
+
+    auto past_the_end = every_16th;
+    past_the_end.back() = {1984, 2000};
+    auto past_the_end_stream = serializedLeaf(0, 1999, past_the_end);
+    ASSERT_FALSE(w5n::Rope::deserialize(past_the_end_stream).has_value());
+
+    // the second byte of "é"
+    auto inside_a_character = every_16th;
+    inside_a_character[1] = {16, 16};
+    auto inside_a_character_stream = serializedLeaf(0, 1999, inside_a_character);
+    ASSERT_FALSE(w5n::Rope::deserialize(inside_a_character_stream).has_value());
+
+    auto line_breaks = serializedLeaf(3, 1999, every_16th);
+    ASSERT_FALSE(w5n::Rope::deserialize(line_breaks).has_value());
+
+    // a rope counting bytes never has a leaf over MAX_LEAF_SIZE
+    std::string oversized;
+    writeVarint(oversized, 0);
+    writeVarint(oversized, 5000);
+    writeVarint(oversized, 0);
+    std::istringstream oversized_leaf{serializedRope(0, std::string(5000, 'a'), oversized)};
+    ASSERT_FALSE(w5n::Rope::deserialize(oversized_leaf).has_value());
+}
+
+#ifdef W5N_ROPE_COUNTERS
+TEST(RopeTest, It_Counts_Tree_Operations)
+{
+    w5n::Rope::resetCounters();
+    auto r = w5n::Rope::fromString(std::string(100000, 'a'));
+    auto counters = w5n::Rope::counters();
+
+    ASSERT_EQ(1, counters.bufferAllocations);
+    ASSERT_EQ(r.stats().nodes, counters.nodeAllocations);
+    ASSERT_EQ(0, counters.splits);
+
+    r.insert(50001, "b");
+    ASSERT_EQ(1, w5n::Rope::counters().splits);
+    ASSERT_GT(w5n::Rope::counters().concats, 0);
+
+    w5n::Rope::resetCounters();
+    ASSERT_EQ(0, w5n::Rope::counters().nodeAllocations);
+}
+#endif
+
+#ifndef W5N_ROPE_SINGLE_THREADED
+TEST(RopeTest, It_Reads_In_Parallel)
+{
+    std::string content;
+
+    for (size_t i = 0; content.size() < 5'000'000; ++i) {
+        content += "line " + std::to_string(i) + " aaaaaaa\n";
+    }
+
+    content += "needle";
+
+    w5n::Rope r;
+    r.append(content);
+    auto executor = w5n::Rope::threadExecutor(4);
+
+    ASSERT_EQ(content, r.toString(executor));
+    ASSERT_EQ(content.size() - 6, r.find("needle", executor));
+    ASSERT_EQ(std::string::npos, r.find("missing", executor));
+    ASSERT_EQ(r.find("line 99999 ", 0), r.find("line 99999 ", executor));
+    ASSERT_EQ(r.findAll("aaa"), r.findAll("aaa", executor));
+    ASSERT_EQ(r.findAll("\nline 1"), r.findAll("\nline 1", executor));
+
+    r.computeMetrics(executor);
+    ASSERT_EQ(std::count(content.begin(), content.end(), '\n') + 1, r.lineCount());
+}
+
+TEST(RopeTest, It_Builds_In_Parallel)
+{
+    std::string content;
+
+    for (size_t i = 0; content.size() < 3'000'000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+
+    auto r = w5n::Rope::fromString(content, w5n::Rope::threadExecutor(4));
+
+    ASSERT_EQ(content, r.toString());
+    ASSERT_EQ(std::count(content.begin(), content.end(), '\n') + 1, r.lineCount());
+    ASSERT_EQ(content.find("line 12345\n"), r.lineStart(12345));
+}
+
+TEST(RopeTest, It_Accepts_Any_Executor)
+{
+    w5n::Rope r;
+    r.append("Hello World");
+    size_t calls = 0;
+
+    w5n::Rope::Executor serial = [&calls](size_t count, const std::function<void(size_t)>& task) {
+        ++calls;
+
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+    };
+
+    ASSERT_EQ("Hello World", r.toString(serial));
+    ASSERT_EQ(6, r.find("World", serial));
+    ASSERT_EQ(2, calls);
+}
+#endif
+
+TEST(BasicRopeTest, It_Indexes_Bytes_In_A_Byte_Rope)
+{
+    static_assert(std::same_as<w5n::ByteRope::iterator, w5n::ByteRope::ByteIterator>);
+    static_assert(std::same_as<char, decltype(std::declval<w5n::ByteRope>().at(0))>);
+    static_assert(!CountsChars<w5n::ByteRope>);
+
+    w5n::ByteRope r;
+    r.append("😀 log");
+
+    ASSERT_EQ(8, r.size());
+    ASSERT_EQ('\xF0', r.at(0));
+    ASSERT_EQ('l', r.at(5));
+
+    // any offset is a boundary, even inside a code point
+    ASSERT_TRUE(r.insert(2, "x"));
+    ASSERT_TRUE(r.erase(0, 2));
+    ASSERT_EQ("x\x98\x80 log", r.toString());
+    ASSERT_EQ(r.size(), std::ranges::distance(r));
+}
+
+TEST(BasicRopeTest, It_Loads_A_File_As_Bytes)
+{
+    std::string content;
+
+    while (content.size() < 50000) {
+        content += "😀 no line breaks ";
+    }
+
+    auto r = w5n::ByteRope::fromFile(writeTemporaryFile("w5n-rope-test-bytes.txt", content));
+    ASSERT_TRUE(r.has_value());
+    ASSERT_EQ(content, r->toString());
+    ASSERT_EQ(content[30001], r->at(30001));
+    ASSERT_EQ(0, r->stats().underfullLeaves);
+    ASSERT_EQ(content.find("😀", 40000), r->find("😀", 40000));
+}
+
+TEST(BasicRopeTest, It_Indexes_Code_Points)
+{
+    static_assert(std::bidirectional_iterator<w5n::CodePointRope::CharIterator>);
+
+    std::string content;
+    std::vector<std::string> expected;
+
+    for (size_t i = 0; i < 3000; ++i) {
+        const char* code_point = i % 3 == 0 ? "😀" : (i % 3 == 1 ? "e" : "\u0301");
+        content += code_point;
+        expected.emplace_back(code_point);
+    }
+
+    auto r = w5n::CodePointRope::fromString(content);
+    ASSERT_EQ(3000, r.charCount());
+    ASSERT_EQ("\u0301", r.at(2999));
+
+    size_t count = 0;
+    for (auto code_point : r) {
+        ASSERT_EQ(expected[count++], code_point);
+    }
+    ASSERT_EQ(3000, count);
+
+    // a combining mark is a code point of its own, but nothing can go inside the bytes of one
+    ASSERT_TRUE(r.insertAtChar(2, "a"));
+    ASSERT_FALSE(r.insertAtByte(1, "a"));
+    ASSERT_TRUE(r.eraseChars(0, 1));
+    ASSERT_EQ("ea\u0301😀", r.substringChars(0, 4));
+    ASSERT_EQ(3, r.charIndex(4));
+    ASSERT_EQ(std::string::npos, r.charIndex(5));
+}
+
+TEST(BasicRopeTest, It_Keeps_No_Counts_For_Bytes)
+{
+    std::string content;
+
+    for (size_t i = 0; content.size() < 100000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+
+    auto bytes = w5n::ByteRope::fromString(content);
+    auto code_points = w5n::CodePointRope::fromString(content);
+    ASSERT_EQ(code_points.lineCount(), bytes.lineCount());
+    ASSERT_EQ(content.size(), code_points.charCount());
+
+    ASSERT_LT(bytes.stats().exclusiveBytes, code_points.stats().exclusiveBytes);
+}
+
+TEST(BasicRopeTest, It_Reads_Ropes_Serialized_With_Another_Unit)
+{
+    std::string content;
+
+    for (size_t i = 0; content.size() < 20000; ++i) {
+        content += "😀 café " + std::to_string(i) + "\n";
+    }
+
+    auto code_points = w5n::CodePointRope::fromString(content);
+    code_points.charCount();
+
+    std::stringstream stream;
+    ASSERT_TRUE(code_points.serialize(stream));
+    auto bytes = w5n::ByteRope::deserialize(stream);
+
+    ASSERT_TRUE(bytes.has_value());
+    ASSERT_EQ(content, bytes->toString());
+    ASSERT_EQ(code_points.lineCount(), bytes->lineCount());
+
+    stream.str({});
+    ASSERT_TRUE(bytes->serialize(stream));
+    auto restored = w5n::CodePointRope::deserialize(stream);
+
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(code_points.charCount(), restored->charCount());
+    ASSERT_EQ("é", restored->at(5));
+}
+
 #ifndef W5N_ROPE_UTF8_IGNORE
+TEST(Utf8RopeTest, It_Counts_Graphemes_And_Code_Points_Side_By_Side)
+{
+    static_assert(std::same_as<w5n::Rope, w5n::GraphemeRope>);
+
+    const std::string content = "e\u0301👶🏽👩‍💻";
+    auto graphemes = w5n::GraphemeRope::fromString(content);
+    auto code_points = w5n::CodePointRope::fromString(content);
+
+    ASSERT_EQ(3, graphemes.charCount());
+    ASSERT_EQ(7, code_points.charCount());
+    ASSERT_EQ("👶🏽", graphemes.at(1));
+    ASSERT_EQ("👶", code_points.at(2));
+
+    std::stringstream stream;
+    graphemes.serialize(stream);
+    auto restored = w5n::CodePointRope::deserialize(stream);
+
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(7, restored->charCount());
+}
+
 TEST(Utf8RopeTest, It_Erases_Correctly)
 {
     w5n::Rope r;
@@ -242,4 +1279,319 @@ TEST(Utf8RopeTest, It_Splits_Correctly_When_Offset_Is_Bigger_Than_String)
     r.append("😀🙏🙍😻");
     ASSERT_EQ("", r.substring(30, 2));
 }
+
+TEST(Utf8RopeTest, It_Gets_Every_Character_Of_A_Long_Text)
+{
+    const std::vector<std::string> graphemes{"😀", "a", "👶🏽", "ç", "🙏"};
+    std::string content;
+
+    for (size_t i = 0; i < 5000; ++i) {
+        content += graphemes[i % graphemes.size()];
+    }
+
+    w5n::Rope r;
+    r.append(content);
+    ASSERT_EQ(5000, r.charCount());
+
+    for (size_t i = 0; i < r.charCount(); ++i) {
+        ASSERT_EQ(graphemes[i % graphemes.size()], r.at(i));
+    }
+}
+
+TEST(Utf8RopeTest, It_Do_Not_Insert_Past_The_Last_Grapheme)
+{
+    w5n::Rope r;
+    r.append("😀😁");
+    ASSERT_FALSE(r.insert(3, "😂"));
+    ASSERT_TRUE(r.insert(2, "😂"));
+    ASSERT_EQ("😀😁😂", r.toString());
+}
+
+TEST(Utf8RopeTest, It_Edits_By_Byte_Offset)
+{
+    w5n::Rope r;
+    r.append("😀👶🏽😂");
+
+    ASSERT_TRUE(r.insertAtByte(4, "a"));
+    ASSERT_EQ("😀a👶🏽😂", r.toString());
+
+    ASSERT_FALSE(r.insertAtByte(2, "b")); // inside 😀
+    ASSERT_FALSE(r.insertAtByte(9, "b")); // between the baby and its skin tone
+    ASSERT_FALSE(r.eraseBytes(5, 4)); // leaves the skin tone behind
+    ASSERT_EQ("😀a👶🏽😂", r.toString());
+
+    ASSERT_TRUE(r.eraseBytes(5, 8));
+    ASSERT_EQ("😀a😂", r.toString());
+    ASSERT_EQ("a😂", r.substringBytes(4));
+}
+
+TEST(Utf8RopeTest, It_Applies_Edits_On_Grapheme_Boundaries_Only)
+{
+    w5n::Rope r;
+    r.append("😀👶🏽😂");
+
+    const std::array<w5n::Rope::Edit, 2> inside{{{4, 0, "a"}, {9, 0, "b"}}}; // between the baby and its skin tone
+    ASSERT_FALSE(r.applyEdits(inside));
+    ASSERT_EQ("😀👶🏽😂", r.toString());
+
+    const std::array<w5n::Rope::Edit, 2> edits{{{4, 8, "a"}, {16, 0, "!"}}};
+    ASSERT_TRUE(r.applyEdits(edits));
+    ASSERT_EQ("😀a😂!", r.toString());
+    ASSERT_EQ(4, r.charCount());
+}
+
+TEST(Utf8RopeTest, It_Edits_By_Grapheme_Index)
+{
+    w5n::Rope r;
+    r.append("😀👶🏽😂");
+
+    ASSERT_TRUE(r.insertAtChar(2, "a"));
+    ASSERT_EQ("😀👶🏽a😂", r.toString());
+
+    ASSERT_TRUE(r.eraseChars(0, 2));
+    ASSERT_EQ("a😂", r.toString());
+    ASSERT_EQ("😂", r.substringChars(1, 1));
+}
+
+TEST(Utf8RopeTest, It_Iterates_Over_Graphemes)
+{
+    static_assert(std::bidirectional_iterator<w5n::Rope::GraphemeIterator>);
+
+    std::string content;
+    for (size_t i = 0; i < 3000; ++i) {
+        content += i % 3 == 0 ? "😀" : "é";
+    }
+
+    w5n::Rope r;
+    r.append(content);
+
+    size_t count = 0;
+    size_t offset = 0;
+    for (auto it = r.begin(); it != r.end(); ++it, ++count) {
+        ASSERT_EQ(count, it.index());
+        ASSERT_EQ(offset, it.offset());
+        ASSERT_EQ(count % 3 == 0 ? "😀" : "é", *it);
+        offset += (*it).size();
+    }
+    ASSERT_EQ(r.charCount(), count);
+
+    auto it = r.end();
+    for (size_t i = 0; i < 100; ++i) {
+        --it;
+    }
+    ASSERT_EQ(2900, it.index());
+    ASSERT_EQ(r.at(2900), *it);
+    ASSERT_EQ(1000, std::ranges::count(r.graphemes(), std::string_view{"😀"}));
+}
+
+TEST(Utf8RopeTest, It_Converts_Matches_To_Grapheme_Indexes)
+{
+    w5n::Rope r;
+    r.append("😀 Hello, 😁 World 😂");
+
+    auto match = r.find("World");
+    ASSERT_EQ(17, match);
+    ASSERT_EQ(11, r.charIndex(match));
+    ASSERT_EQ(std::string::npos, r.charIndex(1));
+    ASSERT_EQ(r.charCount(), r.charIndex(r.size()));
+}
+
+TEST(Utf8RopeTest, It_Loads_A_File_Without_Splitting_Graphemes)
+{
+    std::string content;
+
+    for (size_t i = 0; i < 3000; ++i) {
+        content += "e\u0301😀";
+    }
+
+    w5n::Rope expected;
+    expected.append(content);
+
+    auto r = w5n::Rope::fromFile(writeTemporaryFile("w5n-rope-test-graphemes.txt", content));
+    ASSERT_TRUE(r.has_value());
+    ASSERT_EQ(content, r->toString());
+    ASSERT_EQ(6000, r->charCount());
+    ASSERT_EQ(expected.charCount(), r->charCount());
+    ASSERT_EQ("😀", r->at(4001));
+}
+
+TEST(Utf8RopeTest, It_Cuts_Leaves_Between_Flags)
+{
+    // each flag is a pair of regional indicators, which only pair up counting from the start of their run
+    const std::string flag = "🇫🇷";
+
+    for (size_t prefix = 3000; prefix < 3016; ++prefix) {
+        std::string flags;
+        for (size_t i = 0; i < 100; ++i) {
+            flags += flag;
+        }
+
+        const auto content = std::string(prefix, 'a') + flags + std::string(3000, 'b');
+        auto r = w5n::Rope::fromString(content);
+
+        ASSERT_EQ(content, r.toString());
+        ASSERT_EQ(prefix + 100 + 3000, r.charCount());
+        ASSERT_EQ(flag, r.at(prefix));
+        ASSERT_EQ(flag, r.at(prefix + 99));
+        ASSERT_EQ(flags, r.substring(prefix, 100));
+    }
+}
+
+TEST(Utf8RopeTest, It_Counts_Graphemes_After_Byte_Edits)
+{
+    std::string line = "naïve cafe\u0301 😀👶🏽\n";
+    w5n::Rope r;
+    std::string expected;
+
+    for (size_t i = 0; i < 1000; ++i) {
+        r.append(line);
+        expected += line;
+    }
+
+    ASSERT_TRUE(r.insertAtByte(line.size() * 500, line));
+    ASSERT_TRUE(r.eraseBytes(0, line.size()));
+    ASSERT_FALSE(r.insertAtByte(line.find("\u0301"), "x"));
+    ASSERT_EQ(expected, r.toString());
+    ASSERT_EQ(14000, r.charCount());
+    ASSERT_EQ("👶🏽", r.at(14000 - 2));
+}
+
+TEST(Utf8RopeTest, It_Serializes_Grapheme_Counts)
+{
+    std::string content;
+
+    for (size_t i = 0; content.size() < 50000; ++i) {
+        content += "😀 café 👩‍💻 line " + std::to_string(i) + "\n";
+    }
+
+    w5n::Rope r;
+    r.append(content);
+    r.insertAtChar(12345, "👍🏽");
+    const auto count = r.charCount();
+
+    std::stringstream stream;
+    ASSERT_TRUE(r.serialize(stream));
+    auto restored = w5n::Rope::deserialize(stream);
+
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(count, restored->charCount());
+
+    for (size_t i = 0; i < count; i += 97) {
+        ASSERT_EQ(r.at(i), restored->at(i));
+    }
+
+    ASSERT_EQ("👍🏽", restored->at(12345));
+}
+
+#ifdef W5N_ROPE_COUNTERS
+TEST(Utf8RopeTest, It_Looks_Up_Lines_Without_Segmenting)
+{
+    std::string content;
+
+    for (size_t i = 0; i < 20000; ++i) {
+        content += "line " + std::to_string(i) + " 😀 café\n";
+    }
+
+    auto r = w5n::GraphemeRope::fromString(content);
+    w5n::Rope::resetCounters();
+
+    ASSERT_EQ(20001, r.lineCount());
+    ASSERT_EQ(content.find("line 500 "), r.lineStart(500));
+    ASSERT_EQ(500, r.offsetToLineCol(r.lineStart(500) + 3).line);
+    ASSERT_TRUE(r.insertAtByte(r.lineStart(10), "new line\n"));
+    ASSERT_EQ(20002, r.lineCount());
+    ASSERT_EQ(0, w5n::Rope::counters().segmentations);
+
+    r.charCount();
+    ASSERT_GT(w5n::Rope::counters().segmentations, 0);
+}
+#endif
+
+TEST(Utf8RopeTest, It_Rejects_Grapheme_Counts_That_Do_Not_Match_The_Text)
+{
+    // 100 ASCII characters claiming to be 5 graphemes, with the one checkpoint that goes with that count
+    auto serializedLeaf = [](size_t char_count) {
+        std::string tree;
+        writeVarint(tree, 0);
+        writeVarint(tree, 100);
+        writeVarint(tree, 1);
+        writeVarint(tree, 0);
+        writeVarint(tree, char_count);
+        writeVarint(tree, 1);
+        writeVarint(tree, 0);
+        writeVarint(tree, 0);
+
+        return std::istringstream{serializedRope(1, std::string(100, 'a'), tree)};
+    };
+
+    auto wrong = serializedLeaf(5);
+    ASSERT_FALSE(w5n::Rope::deserialize(wrong).has_value());
+
+    // the same leaf with checkpoints every 16 graphemes and the right count
+    std::string tree;
+    writeVarint(tree, 0);
+    writeVarint(tree, 100);
+    writeVarint(tree, 1);
+    writeVarint(tree, 0);
+    writeVarint(tree, 100);
+    writeVarint(tree, 7);
+
+    for (size_t i = 0; i < 7; ++i) {
+        writeVarint(tree, i == 0 ? 0 : 16);
+        writeVarint(tree, i == 0 ? 0 : 16);
+    }
+
+    std::istringstream right{serializedRope(1, std::string(100, 'a'), tree)};
+    auto restored = w5n::Rope::deserialize(right);
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(100, restored->charCount());
+    ASSERT_EQ("a", restored->at(50));
+    ASSERT_TRUE(restored->insert(50, "b"));
+}
+
+TEST(Utf8RopeTest, It_Serializes_Leaves_Around_A_Long_Grapheme)
+{
+    // three thousand combining accents on one letter leave no grapheme boundary to cut the leaf at
+    std::string grapheme = "z";
+
+    for (size_t i = 0; i < 3000; ++i) {
+        grapheme += "\xCC\x81";
+    }
+
+    const auto content = std::string(3000, 'a') + grapheme + std::string(3000, 'b');
+    auto r = w5n::Rope::fromString(content);
+    r.charCount();
+    ASSERT_GT(r.stats().leafSizes[12], 0);
+
+    std::stringstream stream;
+    ASSERT_TRUE(r.serialize(stream));
+    auto restored = w5n::Rope::deserialize(stream);
+
+    ASSERT_TRUE(restored.has_value());
+    ASSERT_EQ(content, restored->toString());
+    ASSERT_EQ(6001, restored->charCount());
+    ASSERT_EQ(grapheme, restored->at(3000));
+}
+
+TEST(Utf8RopeTest, It_Joins_Chunks_Splitting_Graphemes)
+{
+    std::string content;
+
+    for (size_t i = 0; i < 2000; ++i) {
+        content += "😀e\u0301";
+    }
+
+    // cut every 7 bytes, in the middle of the code points
+    std::vector<std::string_view> chunks;
+
+    for (size_t i = 0; i < content.size(); i += 7) {
+        chunks.push_back(std::string_view{content}.substr(i, 7));
+    }
+
+    auto r = w5n::Rope::fromChunks(chunks);
+    ASSERT_EQ(content, r.toString());
+    ASSERT_EQ(4000, r.charCount());
+    ASSERT_EQ("e\u0301", r.at(3999));
+}
+
 #endif